@@ -0,0 +1,162 @@
+/**
+ *  Validator.cpp
+ *
+ *  Benchmark of the bson and utf-8 validation. The makefile builds
+ *  it three times: with the scalar, the sse2 and the avx2 path to
+ *  skip over plain ascii, so that the paths can be compared.
+ *
+ *  @copyright 2014 Copernica BV
+ */
+
+#include "../src/includes.h"
+#include <iostream>
+#include <iomanip>
+
+/**
+ *  The path that was compiled in, this follows the checks in validator.cpp
+ *
+ *  @return const char *
+ */
+static const char *path()
+{
+#if defined(REACTCPP_MONGO_SCALAR)
+    return "scalar";
+#elif defined(__AVX2__)
+    return "avx2";
+#elif defined(__SSE2__)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+/**
+ *  Create a string of plain ascii
+ *
+ *  @param  size        size of the string
+ *  @return std::string
+ */
+static std::string ascii(size_t size)
+{
+    // fill the string with printable characters
+    std::string result(size, ' ');
+    for (size_t i = 0; i < size; ++i) result[i] = 'a' + i % 26;
+    return result;
+}
+
+/**
+ *  Create a string of mostly ascii, with a two and a three byte
+ *  sequence every few words, like most european text
+ *
+ *  @param  size        approximate size of the string
+ *  @return std::string
+ */
+static std::string mixed(size_t size)
+{
+    // add words until the string is large enough
+    std::string result;
+    while (result.size() < size) result.append("caf\xc3\xa9 price \xe2\x82\xac 12 and some more text ");
+    return result;
+}
+
+/**
+ *  Append a 32-bit number in little endian byte order
+ *
+ *  @param  buffer      the buffer to append to
+ *  @param  value       the value to append
+ */
+static void append(std::string& buffer, int32_t value)
+{
+    for (int i = 0; i < 4; ++i) buffer.push_back((char)((value >> (8 * i)) & 0xff));
+}
+
+/**
+ *  Create a bson document with many string fields
+ *
+ *  @param  fields      number of fields
+ *  @param  value       the value of every field
+ *  @return std::string
+ */
+static std::string document(size_t fields, const std::string& value)
+{
+    // the length header is filled in at the end
+    std::string result(4, '\0');
+
+    // add all fields
+    for (size_t i = 0; i < fields; ++i)
+    {
+        // the type and the name of the field
+        result.push_back(0x02);
+        result.append("field").append(std::to_string(i)).push_back('\0');
+
+        // the string with its length and terminator
+        append(result, value.size() + 1);
+        result.append(value).push_back('\0');
+    }
+
+    // the document ends with a nul byte
+    result.push_back('\0');
+
+    // fill in the length
+    std::string length;
+    append(length, result.size());
+    result.replace(0, 4, length);
+
+    // done
+    return result;
+}
+
+/**
+ *  Run a check repeatedly for about half a second and report the throughput
+ *
+ *  @param  name        name of the measurement
+ *  @param  size        number of bytes checked per run
+ *  @param  check       the check to run
+ */
+static void measure(const char *name, size_t size, const std::function<bool()>& check)
+{
+    // the clock to measure with
+    using Clock = std::chrono::steady_clock;
+
+    // run until enough time has passed
+    size_t runs = 0;
+    auto start = Clock::now();
+    auto elapsed = std::chrono::duration<double>(0);
+    while (elapsed.count() < 0.5)
+    {
+        // all inputs are valid
+        if (!check()) { std::cerr << name << ": input rejected" << std::endl; exit(1); }
+
+        // another run is done
+        runs += 1;
+        elapsed = Clock::now() - start;
+    }
+
+    // report the number of megabytes per second
+    std::cout << std::left << std::setw(8) << path() << std::setw(24) << name << std::right << std::setw(10) << std::fixed << std::setprecision(1) << (runs * size / elapsed.count() / 1e6) << " MB/s" << std::endl;
+}
+
+/**
+ *  Main procedure
+ *
+ *  @return int
+ */
+int main()
+{
+    // the inputs
+    auto plain = ascii(1 << 20);
+    auto text = mixed(1 << 20);
+    auto short_strings = document(20000, "name of a person");
+    auto long_strings = document(100, ascii(10000));
+
+    // the utf-8 checks
+    measure("utf8 ascii", plain.size(), [&plain]() { return React::Mongo::Validator::utf8(plain.data(), plain.size()); });
+    measure("utf8 mixed", text.size(), [&text]() { return React::Mongo::Validator::utf8(text.data(), text.size()); });
+
+    // the bson checks
+    measure("bson short strings", short_strings.size(), [&short_strings]() { return React::Mongo::Validator::validate(short_strings.data(), short_strings.size()); });
+    measure("bson long strings", long_strings.size(), [&long_strings]() { return React::Mongo::Validator::validate(long_strings.data(), long_strings.size()); });
+
+    // done
+    return 0;
+}
@@ -0,0 +1,145 @@
+/**
+ *  Collection.h
+ *
+ *  Handle to a single collection on a connection. The handle
+ *  stores the namespace once and holds the default options
+ *  used for all operations run through it.
+ *
+ *  @copyright 2014 Copernica BV
+ */
+
+/**
+ *  Set up namespace
+ */
+namespace React { namespace Mongo {
+
+/**
+ *  Collection class
+ */
+class Collection
+{
+private:
+    /**
+     *  The connection to run the operations on
+     */
+    Connection *_connection;
+
+    /**
+     *  Database name and collection, this is shared with
+     *  the workers so it never has to be copied
+     */
+    std::shared_ptr<const std::string> _name;
+
+    /**
+     *  The write concern for inserts, updates and removes
+     */
+    WriteConcern _concern;
+
+    /**
+     *  The options for queries
+     */
+    int _options = 0;
+public:
+    /**
+     *  Constructor
+     *
+     *  @param  connection  the connection to run the operations on
+     *  @param  name        database name and collection
+     */
+    Collection(Connection *connection, const std::string& name) :
+        _connection(connection),
+        _name(std::make_shared<const std::string>(name)) {}
+
+    /**
+     *  Database name and collection
+     *
+     *  @return std::string
+     */
+    const std::string& name() const
+    {
+        return *_name;
+    }
+
+    /**
+     *  Set the write concern for inserts, updates and removes
+     *
+     *  @param  concern     the write concern to wait for
+     */
+    Collection& setWriteConcern(const WriteConcern& concern)
+    {
+        // store the concern
+        _concern = concern;
+        return *this;
+    }
+
+    /**
+     *  Allow queries to be answered by secondaries
+     *
+     *  @param  slaveOk     may queries be answered by secondaries
+     */
+    Collection& setSlaveOk(bool slaveOk)
+    {
+        // set or clear the option
+        if (slaveOk) _options |= mongo::QueryOption_SlaveOk;
+        else _options &= ~mongo::QueryOption_SlaveOk;
+        return *this;
+    }
+
+    /**
+     *  Query the collection
+     *
+     *  @param  query       the query to execute
+     */
+    DeferredQuery& query(Variant::Value&& query);
+    DeferredQuery& query(const Variant::Value& query);
+
+    /**
+     *  Query the collection using a prepared query
+     *
+     *  @param  query       the prepared query to execute
+     *  @param  parameters  the values for the parameters in the query
+     */
+    DeferredQuery& query(const PreparedQuery& query, std::vector<Variant::Value>&& parameters);
+    DeferredQuery& query(const PreparedQuery& query, const std::vector<Variant::Value>& parameters);
+
+    /**
+     *  Insert a document into the collection
+     *
+     *  @param  document    document to insert
+     */
+    DeferredInsert& insert(Variant::Value&& document);
+    DeferredInsert& insert(const Variant::Value& document);
+
+    /**
+     *  Insert a batch of documents into the collection
+     *
+     *  @param  documents   documents to insert
+     */
+    DeferredInsert& insert(std::vector<Variant::Value>&& documents);
+    DeferredInsert& insert(const std::vector<Variant::Value>& documents);
+
+    /**
+     *  Update an existing document in the collection
+     *
+     *  @param  query       the query to find the document(s) to update
+     *  @param  document    the new document to replace existing document with
+     *  @param  upsert      if no matching document was found, create one instead
+     *  @param  multi       if multiple matching documents are found, update them all
+     */
+    DeferredUpdate& update(Variant::Value&& query, Variant::Value&& document, bool upsert = false, bool multi = false);
+    DeferredUpdate& update(const Variant::Value& query, const Variant::Value& document, bool upsert = false, bool multi = false);
+
+    /**
+     *  Remove one or more existing documents from the collection
+     *
+     *  @param  query       the query to find the document(s) to remove
+     *  @param  limitToOne  limit the removal to a single document
+     */
+    DeferredRemove& remove(Variant::Value&& query, bool limitToOne = false);
+    DeferredRemove& remove(const Variant::Value& query, bool limitToOne = false);
+};
+
+/**
+ *  End namespace
+ */
+}}
@@ -24,9 +24,11 @@ private:
     React::Loop *_loop;
 
     /**
-     *  The worker operating on mongo
+     *  Worker converting the batches of query results, this is declared
+     *  before the worker operating on mongo, which waits for it. It is
+     *  only started when read-ahead is enabled for the first time.
      */
-    React::Worker _worker;
+    std::unique_ptr<React::Worker> _converter;
 
     /**
      *  Worker for main thread
@@ -38,6 +40,56 @@ private:
      */
     mongo::DBClientConnection _mongo;
 
+    /**
+     *  The host we are connected to
+     */
+    std::string _host;
+
+    /**
+     *  Limits on the pending operations
+     */
+    Throttle _throttle;
+
+    /**
+     *  Measurements of the queries
+     */
+    Profiler _profiler;
+
+    /**
+     *  Updates of single documents that are not yet sent
+     */
+    WriteBehind _writeBehind;
+
+    /**
+     *  State shared with the timer, so that it stops waiting and no
+     *  longer flushes when the connection is destroyed
+     */
+    struct Lifetime
+    {
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool destroyed = false;
+    };
+    std::shared_ptr<Lifetime> _lifetime;
+
+    /**
+     *  Worker that waits for the flush interval of the updates, this is
+     *  declared after the worker for the main thread, which it posts to.
+     *  It is only started when write-behind is enabled for the first time.
+     */
+    std::unique_ptr<React::Worker> _timer;
+
+    /**
+     *  Should documents be validated?
+     */
+    std::atomic<bool> _validate;
+
+    /**
+     *  Maximum number of batches of query results that are converted
+     *  while the next batch is fetched, zero to fetch and convert in turn
+     */
+    std::atomic<size_t> _readAhead;
+
     /**
      *  Convert a Variant object to a bson object
      *  used by the underlying mongo driver
@@ -54,10 +106,320 @@ private:
      */
     Variant::Value convert(const mongo::BSONObj& value);
 
+    /**
+     *  Convert the parts of a bson object
+     *
+     *  @param  value   the value to convert
+     */
+    Variant::Value convert(const mongo::BSONElement& value);
+    Variant::Value convertArray(const mongo::BSONObj& value);
+    Variant::Value convertObject(const mongo::BSONObj& value);
+
+    /**
+     *  Check a document when validation is enabled
+     *
+     *  @param  document    the encoded document
+     *  @return the same document
+     *  @throws mongo::UserException    if the document is invalid
+     */
+    mongo::BSONObj check(const mongo::BSONObj& document);
+
+    /**
+     *  Receive the results of a query, and decode them while the
+     *  next batch is fetched
+     *
+     *  This method must be called from the worker thread.
+     *
+     *  @param  cursor      the cursor to read from
+     *  @param  measurement the timings of the query
+     *  @param  result      the vector to fill with the decoded documents
+     *  @param  decode      function decoding a document into a Type
+     *  @throws mongo::DBException  if the results could not be received or decoded
+     */
+    template <typename Type, typename Decoder>
+    void receive(mongo::DBClientCursor& cursor, Profiler::Measurement& measurement, std::vector<Type>& result, const Decoder& decode)
+    {
+        // the number of batches that may wait to be decoded
+        size_t depth = _readAhead;
+
+        // without read-ahead we decode the documents ourselves
+        if (depth == 0)
+        {
+            // process all results
+            while (cursor.more())
+            {
+                // receive the next document
+                auto document = cursor.next();
+                measurement.receive(document);
+                measurement.lap(measurement.fetch);
+
+                // decode it
+                result.push_back(decode(document));
+                measurement.lap(measurement.convert);
+            }
+
+            // done
+            return;
+        }
+
+        /**
+         *  The batches that are decoded, shared with the converter
+         */
+        struct Batches
+        {
+            std::mutex mutex;
+            std::condition_variable condition;
+            size_t pending = 0;
+            std::vector<Type> result;
+            std::string error;
+        };
+
+        // the state shared with the converter
+        auto batches = std::make_shared<Batches>();
+
+        // wait until the converter has room for another batch, or is done
+        auto wait = [batches](size_t room) {
+            std::unique_lock<std::mutex> lock(batches->mutex);
+            batches->condition.wait(lock, [batches, room]() { return batches->pending < room; });
+        };
+
+        try
+        {
+            // process all batches, the driver only fetches the next
+            // batch from the server when the current one is consumed
+            while (cursor.more())
+            {
+                // the documents refer to the buffer of the cursor, which
+                // is released when the next batch arrives, so we copy them
+                auto documents = std::make_shared<std::vector<mongo::BSONObj>>();
+                documents->reserve(cursor.objsLeftInBatch());
+
+                // take the documents that are left in the batch
+                while (cursor.moreInCurrentBatch())
+                {
+                    auto document = cursor.next();
+                    measurement.receive(document);
+                    documents->push_back(document.getOwned());
+                }
+                measurement.lap(measurement.fetch);
+
+                // time spent waiting for the converter counts as converting
+                wait(depth);
+                measurement.lap(measurement.convert);
+
+                // the batch is waiting now
+                { std::lock_guard<std::mutex> lock(batches->mutex); batches->pending += 1; }
+
+                // decode the batch while we fetch the next one
+                _converter->execute([batches, documents, decode]() {
+                    /**
+                     *  Whatever happens, the batch must be marked as done
+                     *  when we leave, or the worker would wait forever
+                     */
+                    struct Done
+                    {
+                        std::shared_ptr<Batches> batches;
+                        std::string error;
+
+                        ~Done()
+                        {
+                            std::lock_guard<std::mutex> lock(batches->mutex);
+                            if (batches->error.empty()) batches->error = std::move(error);
+                            batches->pending -= 1;
+                            batches->condition.notify_one();
+                        }
+                    } done{ batches, std::string() };
+
+                    try
+                    {
+                        // decode all documents
+                        std::vector<Type> decoded;
+                        decoded.reserve(documents->size());
+                        for (auto &document : *documents) decoded.push_back(decode(document));
+
+                        // add them to the result, the batches are decoded in order
+                        std::lock_guard<std::mutex> lock(batches->mutex);
+                        for (auto &value : decoded) batches->result.push_back(std::move(value));
+                    }
+                    catch (const mongo::DBException& exception) { done.error = exception.toString(); }
+                    catch (const std::exception& exception) { done.error = *exception.what() ? exception.what() : "Unknown error decoding documents"; }
+                    catch (...) { done.error = "Unknown error decoding documents"; }
+                });
+            }
+        }
+        catch (...)
+        {
+            // let the converter finish before we report the failure
+            wait(1);
+            throw;
+        }
+
+        // wait for the last batches
+        wait(1);
+        measurement.lap(measurement.convert);
+
+        // did decoding fail?
+        if (!batches->error.empty()) throw mongo::UserException(0, batches->error);
+
+        // we now have all results
+        result = std::move(batches->result);
+    }
+
+    /**
+     *  Run a query and collect the decoded results
+     *
+     *  This method must be called from the worker thread. Slow queries
+     *  are reported to the profiler.
+     *
+     *  @param  collection  database name and collection
+     *  @param  query       the encoded query to execute
+     *  @param  options     query options
+     *  @param  submitted   when the query was started on the event loop
+     *  @param  decode      function decoding a document into a Type
+     *  @return the decoded documents
+     *  @throws mongo::DBException  if the query failed
+     */
+    template <typename Type, typename Decoder>
+    std::shared_ptr<std::vector<Type>> collect(const std::string& collection, const mongo::Query& query, int options, Profiler::Clock::time_point submitted, const Decoder& decode)
+    {
+        // start measuring
+        auto measurement = _profiler.start(submitted);
+
+        // execute query
+        auto cursor = _mongo.query(collection, query, 0, 0, nullptr, options);
+        measurement.lap(measurement.server);
+
+        /**
+         *  Even though mongo can throw exceptions for the query
+         *  function, it communicates connection failures not by
+         *  throwing an exception, but instead returning 0 when
+         *  a connection failure occurs, so we check for this.
+         */
+        if (cursor.get() == NULL) throw mongo::UserException(0, "Unspecified connection error");
+
+        // process all results
+        auto result = std::make_shared<std::vector<Type>>();
+        receive(*cursor, measurement, *result, decode);
+
+        // report the query if it was slow
+        if (_profiler.slow(measurement)) report(collection, query, measurement);
+
+        // done
+        return result;
+    }
+
+    /**
+     *  Run a query and report the results to the deferred.
+     *
+     *  This method must be called from the worker thread.
+     *
+     *  @param  collection  database name and collection
+     *  @param  query       the encoded query to execute
+     *  @param  options     query options
+     *  @param  deferred    the deferred to report to
+     *  @param  submitted   when the query was started on the event loop
+     *  @param  snapshot    the write behind snapshot taken when the query was started
+     */
+    void fetch(const std::shared_ptr<const std::string>& collection, const mongo::Query& query, int options, const std::shared_ptr<DeferredQuery>& deferred, Profiler::Clock::time_point submitted, size_t snapshot);
+
+    /**
+     *  Report a query that took longer than the threshold
+     *
+     *  This method must be called from the worker thread.
+     *
+     *  @param  collection  database name and collection
+     *  @param  query       the query that was executed
+     *  @param  measurement the timings of the query
+     */
+    void report(const std::string& collection, const mongo::Query& query, const Profiler::Measurement& measurement);
+
+    /**
+     *  Report the result of a write operation to the deferred.
+     *
+     *  This method must be called from the worker thread.
+     *
+     *  @param  deferred    the deferred to report to
+     *  @param  concern     the write concern to wait for
+     */
+    void acknowledge(const std::shared_ptr<Deferred<>>& deferred, const WriteConcern& concern);
+
+    /**
+     *  Run a job in the worker, and remove it from the
+     *  pending operations when it is finished
+     *
+     *  @param  documents   number of documents in the operation
+     *  @param  job         the job to run
+     */
+    void execute(size_t documents, std::function<void()>&& job);
+
+    /**
+     *  Reject an operation because the limits are exceeded
+     *
+     *  @param  deferred    the deferred of the operation
+     *  @return the deferred handler
+     */
+    template <typename Type>
+    Type& reject(const std::shared_ptr<Type>& deferred)
+    {
+        // report the failure from the event loop, the caller must
+        // have had a chance to install the callbacks first
+        _master.execute([deferred]() { deferred->failure("Too many pending operations"); });
+
+        // return the deferred handler
+        return *deferred;
+    }
+
+    /**
+     *  Implementations of the operations, the namespace is passed
+     *  as a shared pointer, so that the workers do not have to copy
+     *  it, and collection handles can pass in their own options.
+     *
+     *  @param  collection  database name and collection
+     *  @param  options     query options
+     *  @param  concern     the write concern to wait for
+     */
+    DeferredQuery& query(const std::shared_ptr<const std::string>& collection, Variant::Value&& query, int options);
+    DeferredQuery& query(const std::shared_ptr<const std::string>& collection, const PreparedQuery& query, std::vector<Variant::Value>&& parameters, int options);
+    DeferredInsert& insert(const std::shared_ptr<const std::string>& collection, Variant::Value&& document, const WriteConcern& concern);
+    DeferredInsert& insert(const std::shared_ptr<const std::string>& collection, std::vector<Variant::Value>&& documents, const WriteConcern& concern);
+    DeferredUpdate& update(const std::shared_ptr<const std::string>& collection, Variant::Value&& query, Variant::Value&& document, bool upsert, bool multi, const WriteConcern& concern);
+    DeferredRemove& remove(const std::shared_ptr<const std::string>& collection, Variant::Value&& query, bool limitToOne, const WriteConcern& concern);
+
     /**
      *  Callback to execute once the connection is established
      */
     std::function<void(const char *error)> _connectCallback;
+
+    /**
+     *  The sessions that were not ended yet
+     */
+    std::list<std::unique_ptr<Session>> _sessions;
+
+    /**
+     *  Remove a session after its last operation finished
+     *
+     *  @param  session     the session to remove
+     */
+    void endSession(Session *session);
+
+    /**
+     *  The worker operating on mongo, this is declared after the members
+     *  it uses, so that it finishes its operations while they still exist
+     */
+    React::Worker _worker;
+
+    /**
+     *  The active subscriptions, these are declared last
+     *  so that they are stopped before anything else
+     */
+    std::list<std::unique_ptr<Subscription>> _subscriptions;
+
+    /**
+     *  Remove a subscription after its worker stopped
+     *
+     *  @param  subscription    the subscription to remove
+     */
+    void unsubscribe(Subscription *subscription);
 public:
     /**
      *  Establish a connection to a mongo daemon or mongos instance.
@@ -71,6 +433,14 @@ public:
      */
     Connection(React::Loop *loop, const std::string& host);
 
+    /**
+     *  Destructor
+     *
+     *  The updates that were collected for write-behind are sent
+     *  before the connection is closed.
+     */
+    virtual ~Connection();
+
     /**
      *  Get a call when the connection succeeds or fails
      *
@@ -78,6 +448,115 @@ public:
      */
     void onConnected(const std::function<void(const char *error)>& callback);
 
+    /**
+     *  Enable or disable validation of documents
+     *
+     *  When enabled, documents that are inserted or used to update are
+     *  checked after they are converted to bson, and documents returned
+     *  by queries are checked before they are converted. The structure
+     *  of the bson is verified, as well as the utf-8 encoding of all
+     *  strings and field names. An invalid document makes the operation
+     *  fail. The checks run in the worker thread.
+     *
+     *  @param  validate    should documents be validated
+     */
+    void setValidation(bool validate);
+
+    /**
+     *  Convert query results while the next batch is fetched
+     *
+     *  By default, the worker receives a batch of results from the server,
+     *  converts it, and only then requests the next batch. With read-ahead,
+     *  the batches are converted by a separate thread, so the next batch is
+     *  fetched in the meantime, and large results take about as long as the
+     *  slowest of the two instead of both together. The depth limits the
+     *  number of batches waiting to be converted, and thus the memory used.
+     *  The thread is started when read-ahead is enabled for the first time.
+     *
+     *  @param  batches     maximum number of batches waiting, zero to disable
+     */
+    void setReadAhead(size_t batches);
+
+    /**
+     *  Limit the number of pending operations
+     *
+     *  Operations are pending from the moment they are started until the
+     *  worker finished them. Batch inserts count as a single operation
+     *  with multiple documents, all other operations count as one operation
+     *  with one document. When a new operation would exceed the limits,
+     *  the policy decides whether it fails, whether the call blocks until
+     *  there is room, or whether it is accepted and the overload callback
+     *  is called.
+     *
+     *  @param  operations  maximum number of pending operations, zero for no limit
+     *  @param  documents   maximum number of pending documents, zero for no limit
+     *  @param  policy      what to do when the limits are reached
+     */
+    void setLimits(size_t operations, size_t documents = 0, Overload policy = Overload::Fail);
+
+    /**
+     *  Get a call when the limits are exceeded, with the notify policy
+     *
+     *  @param  callback    the callback to execute
+     */
+    void onOverload(const std::function<void()>& callback);
+
+    /**
+     *  Get a call when the pending operations dropped below half the
+     *  limits again, after the overload callback was called
+     *
+     *  @param  callback    the callback to execute
+     */
+    void onDrained(const std::function<void()>& callback);
+
+    /**
+     *  Get a call for every query that takes longer than a threshold
+     *
+     *  The callback receives the namespace, the shape of the query with
+     *  all values left out, the time spent waiting for the worker, on the
+     *  server and network, and on converting the results, and the number
+     *  of documents and bytes received. When explain is set, the plan of
+     *  every slow shape is requested once, and passed along with all slow
+     *  queries of that shape, which helps to find missing indexes.
+     *
+     *  connection.onSlowOperation(100, [](const SlowOperation& operation) {
+     *      // log the operation here
+     *  }, true);
+     *
+     *  @param  threshold   threshold in milliseconds
+     *  @param  callback    the callback, or an empty function to stop measuring
+     *  @param  explain     should the plan of slow shapes be requested?
+     */
+    void onSlowOperation(double threshold, const std::function<void(const SlowOperation&)>& callback, bool explain = false);
+
+    /**
+     *  Collect updates of hot documents and send them periodically
+     *
+     *  When enabled, updates that select a single document by its _id,
+     *  and that only use $inc, $max, $min and $set on top level fields,
+     *  are not sent right away, but merged with the other updates of the
+     *  same document and sent once per interval. The _id must be a string,
+     *  an integer, or a double that holds an integer. A thousand increments
+     *  of the same counter thus become a single update. The deferreds
+     *  are informed when the merged update was sent.
+     *
+     *  Queries see the updates that were not yet applied by the server,
+     *  they are applied to the documents before they are reported. Other
+     *  reads, updates and removes of the collection, the operations of
+     *  sessions and commands flush the buffer first.
+     *
+     *  connection.setWriteBehind(0.1);
+     *  connection.update("database.counters", counter, increment);
+     *
+     *  @param  interval    interval in seconds, zero sends the updates right away again
+     */
+    void setWriteBehind(double interval);
+
+    /**
+     *  Send the collected updates right away
+     */
+    void flush();
+
     /**
      *  Query a collection
      *
@@ -114,6 +593,47 @@ public:
      */
     DeferredQuery& query(const std::string& collection, const Variant::Value& query);
 
+    /**
+     *  Prepare a query for repeated execution
+     *
+     *  The query is converted to bson only once. The given parameters
+     *  are dotted paths to values in the query that are replaced on
+     *  every execution, the value found in the template determines the
+     *  type of the parameter. For example:
+     *
+     *  Variant::Value query;
+     *  query["_id"] = "";
+     *  auto prepared = connection.prepare(query, { "_id" });
+     *  connection.query("database.collection", prepared, { "documentid" });
+     *
+     *  @param  query       the query template
+     *  @param  parameters  paths of the values to replace on execution
+     *  @throws std::invalid_argument   if a parameter cannot be found, is not supported, or overlaps another
+     */
+    PreparedQuery prepare(const Variant::Value& query, const std::vector<std::string>& parameters);
+
+    /**
+     *  Query a collection using a prepared query
+     *
+     *  @param  collection  database name and collection
+     *  @param  query       the prepared query to execute
+     *  @param  parameters  the values for the parameters in the query
+     */
+    DeferredQuery& query(const std::string& collection, const PreparedQuery& query, std::vector<Variant::Value>&& parameters);
+
+    /**
+     *  Query a collection using a prepared query
+     *
+     *  Note:   This function will make a copy of the parameters. This
+     *          can be useful when you want to reuse the given parameters,
+     *          otherwise it is best to pass in an rvalue and avoid the copy.
+     *
+     *  @param  collection  database name and collection
+     *  @param  query       the prepared query to execute
+     *  @param  parameters  the values for the parameters in the query
+     */
+    DeferredQuery& query(const std::string& collection, const PreparedQuery& query, const std::vector<Variant::Value>& parameters);
+
     /**
      *  Insert a document into a collection
      *
@@ -137,6 +657,21 @@ public:
     /**
      *  Insert a batch of documents into a collection
      *
+     *  The documents are converted to bson in the worker thread,
+     *  so the event loop is not held up by large batches.
+     *
+     *  @param  collection  database name and collection
+     *  @param  documents   documents to insert
+     */
+    DeferredInsert& insert(const std::string& collection, std::vector<Variant::Value>&& documents);
+
+    /**
+     *  Insert a batch of documents into a collection
+     *
+     *  Note:   This function will make a copy of the documents. This
+     *          can be useful when you want to reuse the given documents,
+     *          otherwise it is best to pass in an rvalue and avoid the copy.
+     *
      *  @param  collection  database name and collection
      *  @param  documents   documents to insert
      */
@@ -220,6 +755,336 @@ public:
      */
     DeferredRemove& remove(const std::string& collection, const Variant::Value& query, bool limitToOne = false);
 
+    /**
+     *  Query a collection, storing the results in a temporary file
+     *
+     *  This is meant for results that do not fit in memory. The documents
+     *  are written to the file unchanged, as they are received. When the
+     *  query is done, the file is mapped into memory and passed to the
+     *  onSuccess callback, so only the documents that are used are loaded.
+     *  The file is removed when the documents are destroyed.
+     *
+     *  connection.spill("database.collection", Variant::Value()).onSuccess([](Documents&& documents) {
+     *      for (size_t i = 0; i < documents.size(); ++i) process(documents[i]);
+     *  });
+     *
+     *  @param  collection  database name and collection
+     *  @param  query       the query to execute
+     *  @param  directory   directory to create the temporary file in
+     */
+    DeferredSpill& spill(const std::string& collection, Variant::Value&& query, const std::string& directory = "/tmp");
+
+    /**
+     *  Query a collection, storing the results in a temporary file
+     *
+     *  Note:   This function will make a copy of the query object. This
+     *          can be useful when you want to reuse the given query object,
+     *          otherwise it is best to pass in an rvalue and avoid the copy.
+     *
+     *  @param  collection  database name and collection
+     *  @param  query       the query to execute
+     *  @param  directory   directory to create the temporary file in
+     */
+    DeferredSpill& spill(const std::string& collection, const Variant::Value& query, const std::string& directory = "/tmp");
+
+    /**
+     *  Count the documents matching a query
+     *
+     *  The documents are counted by the server, nothing but
+     *  the number is sent back.
+     *
+     *  @param  collection  database name and collection
+     *  @param  query       the query to match
+     */
+    DeferredCount& count(const std::string& collection, Variant::Value&& query);
+
+    /**
+     *  Count the documents matching a query
+     *
+     *  Note:   This function will make a copy of the query object. This
+     *          can be useful when you want to reuse the given query object,
+     *          otherwise it is best to pass in an rvalue and avoid the copy.
+     *
+     *  @param  collection  database name and collection
+     *  @param  query       the query to match
+     */
+    DeferredCount& count(const std::string& collection, const Variant::Value& query);
+
+    /**
+     *  Check whether any document matches a query
+     *
+     *  Only the _id of a single document is requested, which
+     *  is much cheaper than running the query itself.
+     *
+     *  connection.exists("database.collection", std::move(query)).onSuccess([](bool exists) {
+     *      // do something with the answer here
+     *  });
+     *
+     *  @param  collection  database name and collection
+     *  @param  query       the query to match
+     */
+    DeferredExists& exists(const std::string& collection, Variant::Value&& query);
+
+    /**
+     *  Check whether any document matches a query
+     *
+     *  Note:   This function will make a copy of the query object. This
+     *          can be useful when you want to reuse the given query object,
+     *          otherwise it is best to pass in an rvalue and avoid the copy.
+     *
+     *  @param  collection  database name and collection
+     *  @param  query       the query to match
+     */
+    DeferredExists& exists(const std::string& collection, const Variant::Value& query);
+
+    /**
+     *  Get the distinct values of a field in the documents matching a query
+     *
+     *  The values are passed to the onSuccess callback as an array,
+     *  the documents themselves are not sent.
+     *
+     *  @param  collection  database name and collection
+     *  @param  field       the field to get the values of, may use dots
+     *  @param  query       the query to match, null for all documents
+     */
+    DeferredDistinct& distinct(const std::string& collection, const std::string& field, Variant::Value&& query = Variant::Value());
+
+    /**
+     *  Get the distinct values of a field in the documents matching a query
+     *
+     *  Note:   This function will make a copy of the query object. This
+     *          can be useful when you want to reuse the given query object,
+     *          otherwise it is best to pass in an rvalue and avoid the copy.
+     *
+     *  @param  collection  database name and collection
+     *  @param  field       the field to get the values of, may use dots
+     *  @param  query       the query to match
+     */
+    DeferredDistinct& distinct(const std::string& collection, const std::string& field, const Variant::Value& query);
+
+    /**
+     *  Get many documents by their _id
+     *
+     *  The ids are sent in chunks, with a single $in query per chunk,
+     *  so that hundreds of documents take a few round trips instead of
+     *  one each. When ordered, the onSuccess callback gets an array with
+     *  the documents in the order of the ids, with null for every id that
+     *  was not found. Otherwise it gets an array with just the documents
+     *  that were found, in the order the server returned them.
+     *
+     *  connection.getMany("database.collection", std::move(ids)).onSuccess([](Variant::Value&& documents) {
+     *      // do something with the documents here
+     *  });
+     *
+     *  @param  collection  database name and collection
+     *  @param  ids         the ids of the documents
+     *  @param  ordered     should the documents be returned in the order of the ids?
+     *  @param  chunk       maximum number of ids per query
+     */
+    DeferredQuery& getMany(const std::string& collection, std::vector<Variant::Value>&& ids, bool ordered = true, size_t chunk = 256);
+
+    /**
+     *  Get many documents by their _id
+     *
+     *  Note:   This function will make a copy of the ids. This can be
+     *          useful when you want to reuse the given ids, otherwise
+     *          it is best to pass in an rvalue and avoid the copy.
+     *
+     *  @param  collection  database name and collection
+     *  @param  ids         the ids of the documents
+     *  @param  ordered     should the documents be returned in the order of the ids?
+     *  @param  chunk       maximum number of ids per query
+     */
+    DeferredQuery& getMany(const std::string& collection, const std::vector<Variant::Value>& ids, bool ordered = true, size_t chunk = 256);
+
+    /**
+     *  Atomically find a document and modify it
+     *
+     *  The first document matching the query, in the sort order of the
+     *  options, is updated or replaced, and the original or the modified
+     *  document is passed to the onSuccess callback, or null when no
+     *  document matched. This takes a single round trip, and no other
+     *  operation can modify the document in between, which makes it
+     *  suitable for claiming jobs from a queue.
+     *
+     *  connection.findAndModify("database.jobs", std::move(waiting), std::move(claim), ModifyOptions(priority, Variant::Value(), false, true)).onSuccess([](Variant::Value&& job) {
+     *      // process the job here, unless it is null
+     *  });
+     *
+     *  @param  collection  database name and collection
+     *  @param  query       the query to find the document
+     *  @param  document    the update, or the document to replace it with
+     *  @param  options     sort order, fields to return, upsert and return new
+     */
+    DeferredModify& findAndModify(const std::string& collection, Variant::Value&& query, Variant::Value&& document, const ModifyOptions& options = ModifyOptions());
+
+    /**
+     *  Atomically find a document and modify it
+     *
+     *  Note:   This function will make a copy of the query and document object.
+     *          This can be useful when you want to reuse the given document object,
+     *          otherwise it is best to pass in an rvalue and avoid the copy.
+     *
+     *  @param  collection  database name and collection
+     *  @param  query       the query to find the document
+     *  @param  document    the update, or the document to replace it with
+     *  @param  options     sort order, fields to return, upsert and return new
+     */
+    DeferredModify& findAndModify(const std::string& collection, const Variant::Value& query, const Variant::Value& document, const ModifyOptions& options = ModifyOptions());
+
+    /**
+     *  Query a collection, decoding the results into mapped structures
+     *
+     *  The documents are decoded straight from bson into the structure,
+     *  without being converted to Variant values first. The structure
+     *  must have a Mapping specialization (see mapping.h) and must be
+     *  default constructible. It can be used like this:
+     *
+     *  connection.query<User>("database.users", Variant::Value()).onSuccess([](std::vector<User>&& users) {
+     *      // do something with the users here
+     *  });
+     *
+     *  @param  collection  database name and collection
+     *  @param  query       the query to execute
+     */
+    template <typename Type>
+    Deferred<std::vector<Type>&&>& query(const std::string& collection, Variant::Value&& query)
+    {
+        // move the query to a pointer to avoid needless copying
+        auto request = std::make_shared<Variant::Value>(std::move(query));
+
+        // create the deferred handler
+        auto deferred = std::make_shared<Deferred<std::vector<Type>&&>>();
+
+        // the collected updates cannot be applied to the structures,
+        // so they are sent first, the query then runs after them
+        if (_writeBehind.pending(collection)) flush();
+
+        // check whether we are within the limits
+        if (!_throttle.acquire(1)) return reject(deferred);
+
+        // when the query was started
+        auto submitted = Profiler::Clock::now();
+
+        // run the query in the worker
+        execute(1, [this, collection, request, deferred, submitted]() {
+            try
+            {
+                // decode the documents straight into the structures
+                auto result = collect<Type>(collection, convert(*request), 0, submitted, [this](const mongo::BSONObj& document) {
+                    Type object;
+                    Mapper::decode(check(document), object);
+                    return object;
+                });
+
+                // we now have all results, execute callback in master thread
+                _master.execute([result, deferred]() { deferred->success(std::move(*result)); });
+            }
+            catch (mongo::DBException& exception)
+            {
+                // something went awry, notify listener
+                _master.execute([deferred, exception]() { deferred->failure(exception.toString().c_str()); });
+            }
+        });
+
+        // return the deferred handler
+        return *deferred;
+    }
+
+    /**
+     *  Query a collection, decoding the results into mapped structures
+     *
+     *  Note:   This function will make a copy of the query object. This
+     *          can be useful when you want to reuse the given query object,
+     *          otherwise it is best to pass in an rvalue and avoid the copy.
+     *
+     *  @param  collection  database name and collection
+     *  @param  query       the query to execute
+     */
+    template <typename Type>
+    Deferred<std::vector<Type>&&>& query(const std::string& collection, const Variant::Value& query)
+    {
+        // move a copy to the implementation
+        return this->query<Type>(collection, Variant::Value(query));
+    }
+
+    /**
+     *  Insert a batch of mapped structures into a collection
+     *
+     *  The structures are encoded straight to bson in the worker thread,
+     *  the structure must have a Mapping specialization (see mapping.h).
+     *
+     *  @param  collection  database name and collection
+     *  @param  objects     the objects to insert
+     */
+    template <typename Type>
+    DeferredInsert& insert(const std::string& collection, std::vector<Type>&& objects)
+    {
+        // move the objects to a pointer to avoid needless copying
+        auto insert = std::make_shared<std::vector<Type>>(std::move(objects));
+
+        // create the deferred handler
+        auto deferred = std::make_shared<DeferredInsert>();
+
+        // check whether we are within the limits
+        if (!_throttle.acquire(insert->size())) return reject(deferred);
+
+        // run the insert in the worker
+        execute(insert->size(), [this, collection, insert, deferred]() {
+            try
+            {
+                // create a new vector with the mongo objects
+                std::vector<mongo::BSONObj> documents;
+                documents.reserve(insert->size());
+
+                // encode all objects
+                for (auto &object : *insert) documents.push_back(check(Mapper::encode(object)));
+
+                // execute the insert
+                _mongo.insert(collection, documents);
+
+                // report the result
+                acknowledge(deferred, WriteConcern());
+            }
+            catch (mongo::DBException& exception)
+            {
+                // inform the listener of the specific failure
+                _master.execute([deferred, exception]() { deferred->failure(exception.toString().c_str()); });
+            }
+        });
+
+        // return the deferred handler
+        return *deferred;
+    }
+
+    /**
+     *  Insert a batch of mapped structures into a collection
+     *
+     *  Note:   This function will make a copy of the objects. This
+     *          can be useful when you want to reuse the given objects,
+     *          otherwise it is best to pass in an rvalue and avoid the copy.
+     *
+     *  @param  collection  database name and collection
+     *  @param  objects     the objects to insert
+     */
+    template <typename Type>
+    DeferredInsert& insert(const std::string& collection, const std::vector<Type>& objects)
+    {
+        // move a copy to the implementation
+        return insert(collection, std::vector<Type>(objects));
+    }
+
+    /**
+     *  Get a handle to a collection
+     *
+     *  The handle stores the namespace once, so that operations through
+     *  it do not have to copy it, and holds default options for them.
+     *  The handle may not outlive the connection.
+     *
+     *  @param  collection  database name and collection
+     */
+    Collection collection(const std::string& collection);
+
     /**
      *  Run a command on the connection.
      *
@@ -247,6 +1112,93 @@ public:
      *  @param  command     the command to execute
      */
     DeferredCommand& runCommand(const std::string& database, Variant::Value&& query);
+
+    /**
+     *  Start a logical session
+     *
+     *  Operations in a session run on this connection, in the order in
+     *  which they were started. In a causally consistent session, reads
+     *  see the results of the earlier operations in the session, also
+     *  when they are served by a secondary. Sessions are needed for
+     *  multi-document transactions. The session is owned by the
+     *  connection, call its end() method when it is no longer needed.
+     *
+     *  auto &session = connection.startSession();
+     *  session.startTransaction();
+     *  session.update("database.accounts", std::move(from), std::move(debit));
+     *  session.update("database.accounts", std::move(to), std::move(credit));
+     *  session.commit().onSuccess([]() {
+     *      // both updates are permanent
+     *  });
+     *
+     *  @param  causal      should reads see the results of earlier operations?
+     */
+    Session& startSession(bool causal = true);
+
+    /**
+     *  Follow a capped collection using a tailable cursor
+     *
+     *  All documents matching the query are passed to the onData callback
+     *  of the returned subscription, including the documents inserted after
+     *  the subscription was created. Waiting for new documents happens on a
+     *  separate connection, so other operations are not held up by it.
+     *
+     *  When the cursor is lost, it is reopened for the documents matching
+     *  the query with an _id larger than that of the last document received.
+     *  This assumes that the _id values increase in the order in which the
+     *  documents are inserted, which holds for ids generated by the server,
+     *  but not necessarily for ids generated by multiple clients.
+     *
+     *  @param  collection  database name and capped collection
+     *  @param  query       the query to find documents to follow
+     */
+    Subscription& tail(const std::string& collection, Variant::Value&& query);
+
+    /**
+     *  Follow a capped collection using a tailable cursor
+     *
+     *  Note:   This function will make a copy of the query object. This
+     *          can be useful when you want to reuse the given query object,
+     *          otherwise it is best to pass in an rvalue and avoid the copy.
+     *
+     *  @param  collection  database name and capped collection
+     *  @param  query       the query to find documents to follow
+     */
+    Subscription& tail(const std::string& collection, const Variant::Value& query);
+
+    /**
+     *  Watch a change stream on a collection
+     *
+     *  Every change event is passed to the onData callback of the returned
+     *  subscription. When the stream is lost, it is resumed after the last
+     *  event received. To continue from an earlier subscription, pass the
+     *  value returned by its token() method.
+     *
+     *  @param  collection  database name and collection
+     *  @param  pipeline    additional aggregation stages to filter the events
+     *  @param  token       resume token to continue after
+     */
+    Subscription& watch(const std::string& collection, Variant::Value&& pipeline = Variant::Value(), const mongo::BSONObj& token = mongo::BSONObj());
+
+    /**
+     *  Watch a change stream on a collection
+     *
+     *  Note:   This function will make a copy of the pipeline object. This
+     *          can be useful when you want to reuse the given pipeline object,
+     *          otherwise it is best to pass in an rvalue and avoid the copy.
+     *
+     *  @param  collection  database name and collection
+     *  @param  pipeline    additional aggregation stages to filter the events
+     *  @param  token       resume token to continue after
+     */
+    Subscription& watch(const std::string& collection, const Variant::Value& pipeline, const mongo::BSONObj& token = mongo::BSONObj());
+
+    // subscriptions, sessions, gridfs, transfers and collections use our private members
+    friend class Subscription;
+    friend class Session;
+    friend class GridFS;
+    friend class Transfer;
+    friend class Collection;
 };
 
 /**
@@ -12,8 +12,13 @@
  */
 namespace React { namespace Mongo {
 
-// forward declaration
+// forward declarations
 class Connection;
+class Collection;
+class GridFS;
+class Session;
+class Documents;
+class Transfer;
 
 /**
  *  Deferred class
@@ -135,8 +140,11 @@ public:
         return *this;
     }
 
-    // the connection class may call private methods
+    // the connection, gridfs, session and transfer classes may call private methods
     friend class Connection;
+    friend class GridFS;
+    friend class Session;
+    friend class Transfer;
 };
 
 /**
@@ -164,6 +172,62 @@ using DeferredRemove  = Deferred<>;
  */
 using DeferredCommand = Deferred<Variant::Value&&>;
 
+/**
+ *  Deferred types for counting and checking documents
+ *
+ *  Their callbacks get the number of matching documents,
+ *  or whether any document matched
+ */
+using DeferredCount  = Deferred<size_t>;
+using DeferredExists = Deferred<bool>;
+
+/**
+ *  Deferred type for distinct
+ *
+ *  It gets the array of distinct values in its onSuccess
+ *  method as an rvalue reference
+ */
+using DeferredDistinct = Deferred<Variant::Value&&>;
+
+/**
+ *  Deferred type for find and modify
+ *
+ *  It gets the document, or null if no document matched,
+ *  in its onSuccess method as an rvalue reference
+ */
+using DeferredModify = Deferred<Variant::Value&&>;
+
+/**
+ *  Deferred types for gridfs transfers
+ *
+ *  Their callbacks get the number of bytes transferred
+ */
+using DeferredUpload   = Deferred<size_t>;
+using DeferredDownload = Deferred<size_t>;
+
+/**
+ *  Deferred type for copying collections
+ *
+ *  Its callback gets the number of documents transferred
+ */
+using DeferredTransfer = Deferred<size_t>;
+
+/**
+ *  Deferred type for queries that store their results in a file
+ *
+ *  They get the mapped documents in their onSuccess
+ *  method as an rvalue reference
+ */
+using DeferredSpill = Deferred<Documents&&>;
+
+/**
+ *  Deferred types for ending transactions
+ *
+ *  Their callbacks don't get any extra parameters
+ */
+using DeferredCommit = Deferred<>;
+using DeferredAbort  = Deferred<>;
+
 /**
  *  End namespace
  */
@@ -0,0 +1,111 @@
+/**
+ *  Documents.h
+ *
+ *  A sequence of documents that is stored in a temporary file
+ *  and mapped into memory, for results that are too large to
+ *  be kept in memory. Only the parts that are used are loaded,
+ *  and the operating system can drop them again when memory
+ *  is needed for something else.
+ *
+ *  @copyright 2014 Copernica BV
+ */
+
+/**
+ *  Set up namespace
+ */
+namespace React { namespace Mongo {
+
+/**
+ *  Documents class
+ */
+class Documents
+{
+private:
+    /**
+     *  The mapped file, or a null pointer if it is empty
+     */
+    const char *_data = nullptr;
+
+    /**
+     *  Size of the mapped file
+     */
+    size_t _size = 0;
+
+    /**
+     *  Offset of every document in the file
+     */
+    std::vector<size_t> _offsets;
+public:
+    /**
+     *  Constructor
+     *
+     *  The file is mapped into memory, and may be closed afterwards.
+     *
+     *  @param  fd          the file holding the encoded documents
+     *  @param  size        size of the file
+     *  @param  offsets     offset of every document in the file
+     *  @throws mongo::UserException    if the file could not be mapped
+     */
+    Documents(int fd, size_t size, std::vector<size_t>&& offsets);
+
+    /**
+     *  We cannot be copied
+     */
+    Documents(const Documents& that) = delete;
+
+    /**
+     *  But we can be moved
+     *
+     *  @param  that        the documents to move
+     */
+    Documents(Documents&& that) : _data(that._data), _size(that._size), _offsets(std::move(that._offsets))
+    {
+        // the other object no longer owns the mapping
+        that._data = nullptr;
+        that._size = 0;
+    }
+
+    /**
+     *  Destructor
+     */
+    ~Documents();
+
+    /**
+     *  Number of documents
+     *
+     *  @return size_t
+     */
+    size_t size() const
+    {
+        return _offsets.size();
+    }
+
+    /**
+     *  Total size of the encoded documents
+     *
+     *  @return size_t
+     */
+    size_t bytes() const
+    {
+        return _size;
+    }
+
+    /**
+     *  Get a document
+     *
+     *  The returned object refers to the mapped file, it
+     *  may not be used after the documents are destroyed.
+     *
+     *  @param  index       index of the document
+     *  @return mongo::BSONObj
+     */
+    mongo::BSONObj operator[](size_t index) const
+    {
+        return mongo::BSONObj(_data + _offsets[index]);
+    }
+};
+
+/**
+ *  End namespace
+ */
+}}
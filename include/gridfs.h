@@ -0,0 +1,171 @@
+/**
+ *  GridFS.h
+ *
+ *  Class to store files in and retrieve files from GridFS.
+ *  Files are streamed chunk by chunk between file descriptors
+ *  and the database, so they never have to fit in memory.
+ *
+ *  @copyright 2014 Copernica BV
+ */
+
+/**
+ *  Set up namespace
+ */
+namespace React { namespace Mongo {
+
+/**
+ *  GridFS class
+ */
+class GridFS
+{
+private:
+    /**
+     *  A worker thread with its own connection to mongo,
+     *  so that chunks can be transferred in parallel
+     */
+    struct Channel
+    {
+        /**
+         *  The connection used by the worker
+         */
+        mongo::DBClientConnection mongo;
+
+        /**
+         *  The worker running the transfers, it is declared last so
+         *  that it is stopped before the connection is destroyed
+         */
+        React::Worker worker;
+
+        /**
+         *  Constructor, the connection reconnects automatically
+         */
+        Channel() : mongo(true) {}
+    };
+
+    /**
+     *  The connection we belong to
+     */
+    Connection *_connection;
+
+    /**
+     *  Namespace of the files and chunks collections
+     */
+    std::string _files;
+    std::string _chunks;
+
+    /**
+     *  The channels to transfer data over
+     */
+    std::vector<std::unique_ptr<Channel>> _channels;
+
+    /**
+     *  The channel to use for the next upload
+     */
+    size_t _next = 0;
+
+    /**
+     *  Number of chunks that are sent to the server in a single insert
+     */
+    size_t _window;
+
+    /**
+     *  Have the indexes been created?
+     */
+    std::atomic<bool> _indexed;
+
+    /**
+     *  Create the indexes on the files and chunks collections, unless
+     *  that was already done
+     *
+     *  This must be called from the worker of the channel.
+     *
+     *  @param  channel     the channel to use
+     */
+    void index(Channel *channel);
+
+    /**
+     *  Store a file, reading the data with a function
+     *
+     *  The reader is called from the worker thread for every chunk. It
+     *  should point the data pointer to the data of the chunk and return
+     *  its size, which is smaller than the chunk size only for the last
+     *  chunk. On failure it should return -1.
+     *
+     *  @param  filename    the name to store the file under
+     *  @param  reader      function reading the data of the next chunk
+     *  @param  chunkSize   size of the chunks to store the data in
+     */
+    DeferredUpload& store(const std::string& filename, const std::function<ssize_t(const char *&data)>& reader, size_t chunkSize);
+public:
+    /**
+     *  Constructor
+     *
+     *  Every channel is a separate thread with its own connection to the
+     *  server. Uploads are spread over the channels, downloads use all
+     *  channels to fetch different ranges of chunks in parallel. The
+     *  window is the number of chunks an upload sends to the server at
+     *  once, which also is the maximum number of chunks kept in memory.
+     *
+     *  @param  connection  the connection to the server
+     *  @param  database    the database holding the files
+     *  @param  prefix      prefix of the files and chunks collections
+     *  @param  channels    number of parallel channels
+     *  @param  window      number of chunks to send at once
+     */
+    GridFS(Connection *connection, const std::string& database, const std::string& prefix = "fs", size_t channels = 4, size_t window = 4);
+
+    /**
+     *  We cannot be copied
+     */
+    GridFS(const GridFS& that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~GridFS() {}
+
+    /**
+     *  Store a file, reading the data from a file descriptor
+     *
+     *  The data is read until the end of the file. The file descriptor
+     *  must remain open until the operation completes. On success, the
+     *  number of bytes stored is passed to the callback.
+     *
+     *  @param  filename    the name to store the file under
+     *  @param  fd          file descriptor to read the data from
+     *  @param  chunkSize   size of the chunks to store the data in
+     */
+    DeferredUpload& upload(const std::string& filename, int fd, size_t chunkSize = 255 * 1024);
+
+    /**
+     *  Store a file, reading the data from a buffer
+     *
+     *  The buffer is not copied, so it must remain valid until
+     *  the operation completes.
+     *
+     *  @param  filename    the name to store the file under
+     *  @param  buffer      the data to store
+     *  @param  size        size of the data
+     *  @param  chunkSize   size of the chunks to store the data in
+     */
+    DeferredUpload& upload(const std::string& filename, const char *buffer, size_t size, size_t chunkSize = 255 * 1024);
+
+    /**
+     *  Retrieve a file, writing the data to a file descriptor
+     *
+     *  When multiple files with the same name exist, the most recently
+     *  uploaded one is retrieved. The chunks are written at their offset
+     *  in the file, so the file descriptor must refer to a regular file
+     *  and remain open until the operation completes. On success, the
+     *  length of the file is passed to the callback.
+     *
+     *  @param  filename    the name of the file to retrieve
+     *  @param  fd          file descriptor to write the data to
+     */
+    DeferredDownload& download(const std::string& filename, int fd);
+};
+
+/**
+ *  End namespace
+ */
+}}
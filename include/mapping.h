@@ -0,0 +1,363 @@
+/**
+ *  Mapping.h
+ *
+ *  Templates to encode and decode bson straight from and into
+ *  user defined structures, without going through Variant.
+ *
+ *  A structure is mapped by specializing the Mapping template,
+ *  and listing its fields in a static fields() method:
+ *
+ *  struct User
+ *  {
+ *      std::string name;
+ *      int age;
+ *  };
+ *
+ *  namespace React { namespace Mongo {
+ *  template <> struct Mapping<User>
+ *  {
+ *      template <typename Visitor>
+ *      static void fields(Visitor &visitor)
+ *      {
+ *          visitor("name", &User::name);
+ *          visitor("age",  &User::age);
+ *      }
+ *  };
+ *  }}
+ *
+ *  Supported member types are int, long long, double, bool, std::string,
+ *  other mapped structures and std::vectors of all of these.
+ *
+ *  @copyright 2014 Copernica BV
+ */
+
+/**
+ *  Set up namespace
+ */
+namespace React { namespace Mongo {
+
+/**
+ *  The mapping of a structure, to be specialized by the user
+ */
+template <typename Type>
+struct Mapping;
+
+/**
+ *  Mapper class
+ */
+class Mapper
+{
+private:
+    /**
+     *  Visitor that adds every field of an object to a builder
+     */
+    template <typename Type>
+    class Encoder
+    {
+    private:
+        /**
+         *  The builder to add the fields to
+         */
+        mongo::BSONObjBuilder &_builder;
+
+        /**
+         *  The object being encoded
+         */
+        const Type &_object;
+    public:
+        /**
+         *  Constructor
+         *
+         *  @param  builder     the builder to add the fields to
+         *  @param  object      the object being encoded
+         */
+        Encoder(mongo::BSONObjBuilder &builder, const Type &object) : _builder(builder), _object(object) {}
+
+        /**
+         *  Add a field
+         *
+         *  @param  name        name of the field
+         *  @param  member      the member holding the value
+         */
+        template <typename Member>
+        void operator()(const char *name, Member Type::*member)
+        {
+            encode(_builder, name, _object.*member);
+        }
+    };
+
+    /**
+     *  Visitor that finds the field for an element and decodes it
+     */
+    template <typename Type>
+    class Decoder
+    {
+    private:
+        /**
+         *  The element to decode
+         */
+        const mongo::BSONElement &_element;
+
+        /**
+         *  The object being decoded
+         */
+        Type &_object;
+
+        /**
+         *  Index of the field to check, or -1 to check all fields
+         */
+        int _target;
+
+        /**
+         *  Index of the field that is visited next
+         */
+        int _index = 0;
+
+        /**
+         *  Index of the field that matched, or -1 if none matched yet
+         */
+        int _match = -1;
+    public:
+        /**
+         *  Constructor
+         *
+         *  @param  element     the element to decode
+         *  @param  object      the object being decoded
+         *  @param  target      index of the field to check, or -1 to check all
+         */
+        Decoder(const mongo::BSONElement &element, Type &object, int target) :
+            _element(element), _object(object), _target(target) {}
+
+        /**
+         *  Check a field, and decode the element into it if the name matches
+         *
+         *  @param  name        name of the field
+         *  @param  member      the member to store the value in
+         */
+        template <typename Member>
+        void operator()(const char *name, Member Type::*member)
+        {
+            // the index of this field
+            int index = _index++;
+
+            // skip the field if we already found a match, or if we only check another one
+            if (_match >= 0 || (_target >= 0 && index != _target)) return;
+
+            // compare the names
+            if (strcmp(name, _element.fieldName()) != 0) return;
+
+            // decode the value
+            decode(_element, _object.*member);
+            _match = index;
+        }
+
+        /**
+         *  Index of the field that matched, or -1 if none did
+         *
+         *  @return int
+         */
+        int match() const
+        {
+            return _match;
+        }
+    };
+
+    /**
+     *  Encode the different field types
+     *
+     *  @param  builder     the builder to add the field to
+     *  @param  name        name of the field
+     *  @param  value       the value to add
+     */
+    static void encode(mongo::BSONObjBuilder &builder, const char *name, int value)                  { builder.append(name, value); }
+    static void encode(mongo::BSONObjBuilder &builder, const char *name, long long value)            { builder.append(name, value); }
+    static void encode(mongo::BSONObjBuilder &builder, const char *name, double value)               { builder.append(name, value); }
+    static void encode(mongo::BSONObjBuilder &builder, const char *name, bool value)                 { builder.append(name, value); }
+    static void encode(mongo::BSONObjBuilder &builder, const char *name, const std::string &value)   { builder.append(name, value); }
+
+    /**
+     *  Encode a vector as an array
+     *
+     *  @param  builder     the builder to add the field to
+     *  @param  name        name of the field
+     *  @param  values      the values to add
+     */
+    template <typename Type>
+    static void encode(mongo::BSONObjBuilder &builder, const char *name, const std::vector<Type> &values)
+    {
+        // the builder for the array
+        mongo::BSONObjBuilder array(builder.subarrayStart(name));
+
+        // buffer for the element names, which are the indices
+        char index[16];
+
+        // add all values
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            // the name of the element
+            snprintf(index, sizeof(index), "%zu", i);
+
+            // add the value
+            encode(array, index, values[i]);
+        }
+
+        // the array is finished
+        array.done();
+    }
+
+    /**
+     *  Encode a mapped structure as a nested document
+     *
+     *  @param  builder     the builder to add the field to
+     *  @param  name        name of the field
+     *  @param  value       the value to add
+     */
+    template <typename Type>
+    static void encode(mongo::BSONObjBuilder &builder, const char *name, const Type &value)
+    {
+        // the builder for the nested document
+        mongo::BSONObjBuilder nested(builder.subobjStart(name));
+
+        // add the fields
+        encode(nested, value);
+
+        // the document is finished
+        nested.done();
+    }
+
+    /**
+     *  Decode the different field types
+     *
+     *  @param  element     the element to decode
+     *  @param  value       the value to store the result in
+     */
+    static void decode(const mongo::BSONElement &element, int &value)            { value = element.numberInt(); }
+    static void decode(const mongo::BSONElement &element, long long &value)      { value = element.numberLong(); }
+    static void decode(const mongo::BSONElement &element, double &value)         { value = element.numberDouble(); }
+    static void decode(const mongo::BSONElement &element, bool &value)           { value = element.trueValue(); }
+    static void decode(const mongo::BSONElement &element, std::string &value)    { if (element.type() == mongo::String) value.assign(element.valuestr(), element.valuestrsize() - 1); }
+
+    /**
+     *  Decode an array into a vector
+     *
+     *  @param  element     the element to decode
+     *  @param  values      the vector to store the values in
+     */
+    template <typename Type>
+    static void decode(const mongo::BSONElement &element, std::vector<Type> &values)
+    {
+        // only arrays can be decoded
+        if (element.type() != mongo::Array) return;
+
+        // the array
+        auto array = element.Obj();
+
+        // we know how many values there are
+        values.clear();
+        values.reserve(array.nFields());
+
+        // decode all values
+        for (auto iter = array.begin(); iter.more(); )
+        {
+            // decode into a local value, a vector of bool cannot
+            // give us a reference to its elements
+            Type value{};
+            decode(iter.next(), value);
+
+            // add it
+            values.push_back(std::move(value));
+        }
+    }
+
+    /**
+     *  Decode a nested document into a mapped structure
+     *
+     *  @param  element     the element to decode
+     *  @param  value       the structure to store the result in
+     */
+    template <typename Type>
+    static void decode(const mongo::BSONElement &element, Type &value)
+    {
+        // only documents can be decoded
+        if (element.type() == mongo::Object) decode(element.Obj(), value);
+    }
+public:
+    /**
+     *  Add all fields of a mapped structure to a builder
+     *
+     *  @param  builder     the builder to add the fields to
+     *  @param  object      the object to encode
+     */
+    template <typename Type>
+    static void encode(mongo::BSONObjBuilder &builder, const Type &object)
+    {
+        // the visitor that adds the fields
+        Encoder<Type> encoder(builder, object);
+
+        // visit all fields
+        Mapping<Type>::fields(encoder);
+    }
+
+    /**
+     *  Encode a mapped structure
+     *
+     *  @param  object      the object to encode
+     *  @return mongo::BSONObj
+     */
+    template <typename Type>
+    static mongo::BSONObj encode(const Type &object)
+    {
+        // the builder to add the fields to
+        mongo::BSONObjBuilder builder;
+
+        // add the fields
+        encode(builder, object);
+
+        // return the finished object
+        return builder.obj();
+    }
+
+    /**
+     *  Decode a document into a mapped structure
+     *
+     *  Documents usually hold their fields in the same order as the
+     *  mapping, so for every element the field following the previous
+     *  match is checked first. Only if that one does not match all
+     *  fields are checked. Elements without a field are ignored.
+     *
+     *  @param  document    the document to decode
+     *  @param  object      the object to store the values in
+     */
+    template <typename Type>
+    static void decode(const mongo::BSONObj &document, Type &object)
+    {
+        // the field we expect next
+        int expected = 0;
+
+        // process all elements
+        for (auto iter = document.begin(); iter.more(); )
+        {
+            // the element to decode
+            auto element = iter.next();
+
+            // try the field we expect first
+            Decoder<Type> guess(element, object, expected);
+            Mapping<Type>::fields(guess);
+
+            // did that work?
+            if (guess.match() >= 0) { expected = guess.match() + 1; continue; }
+
+            // try all fields
+            Decoder<Type> search(element, object, -1);
+            Mapping<Type>::fields(search);
+
+            // continue after this field, if there was one
+            if (search.match() >= 0) expected = search.match() + 1;
+        }
+    }
+};
+
+/**
+ *  End namespace
+ */
+}}
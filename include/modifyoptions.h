@@ -0,0 +1,56 @@
+/**
+ *  ModifyOptions.h
+ *
+ *  The options of an atomic find and modify operation
+ *
+ *  @copyright 2014 Copernica BV
+ */
+
+/**
+ *  Set up namespace
+ */
+namespace React { namespace Mongo {
+
+/**
+ *  ModifyOptions class
+ */
+class ModifyOptions
+{
+public:
+    /**
+     *  The order in which the documents are considered, the first
+     *  matching document is modified, null for any order
+     */
+    Variant::Value sort;
+
+    /**
+     *  The fields of the document to return, null for all fields
+     */
+    Variant::Value fields;
+
+    /**
+     *  Should a document be created if none matches?
+     */
+    bool upsert;
+
+    /**
+     *  Should the modified document be returned, instead of the original?
+     */
+    bool returnNew;
+
+    /**
+     *  Constructor
+     *
+     *  @param  sort        the order in which the documents are considered
+     *  @param  fields      the fields of the document to return
+     *  @param  upsert      should a document be created if none matches
+     *  @param  returnNew   should the modified document be returned
+     */
+    ModifyOptions(Variant::Value sort = Variant::Value(), Variant::Value fields = Variant::Value(), bool upsert = false, bool returnNew = false) :
+        sort(std::move(sort)), fields(std::move(fields)), upsert(upsert), returnNew(returnNew) {}
+};
+
+/**
+ *  End namespace
+ */
+}}
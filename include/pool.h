@@ -0,0 +1,132 @@
+/**
+ *  Pool.h
+ *
+ *  A set of connections for applications that run an event
+ *  loop in every thread. Every loop gets its own connections,
+ *  so the results of an operation are delivered on the loop
+ *  that started it, without passing through other threads.
+ *
+ *  @copyright 2014 Copernica BV
+ */
+
+/**
+ *  Set up namespace
+ */
+namespace React { namespace Mongo {
+
+/**
+ *  Pool class
+ */
+class Pool
+{
+private:
+    /**
+     *  The connections of a single loop
+     */
+    struct Shard
+    {
+        /**
+         *  The loop the connections are bound to
+         */
+        React::Loop *loop;
+
+        /**
+         *  The connections, they each have their own worker
+         */
+        std::vector<std::unique_ptr<Connection>> connections;
+
+        /**
+         *  The connection to use next, this is only
+         *  accessed from the thread running the loop
+         */
+        size_t next = 0;
+
+        /**
+         *  Constructor
+         *
+         *  @param  loop        the loop to bind to
+         */
+        Shard(React::Loop *loop) : loop(loop) {}
+    };
+
+    /**
+     *  The connections of all loops, this does not
+     *  change after the pool has been constructed
+     */
+    std::vector<std::unique_ptr<Shard>> _shards;
+public:
+    /**
+     *  Constructor
+     *
+     *  The pool must be constructed before the loops are started,
+     *  because the connections bind to the loops.
+     *
+     *  @param  loops       the loops to create connections for
+     *  @param  host        the host to connect to
+     *  @param  connections number of connections per loop
+     */
+    Pool(const std::vector<React::Loop*>& loops, const std::string& host, size_t connections = 1);
+
+    /**
+     *  We cannot be copied
+     */
+    Pool(const Pool& that) = delete;
+
+    /**
+     *  Number of loops in the pool
+     *
+     *  @return size_t
+     */
+    size_t size() const
+    {
+        return _shards.size();
+    }
+
+    /**
+     *  Get a call for every connection of a loop, when it succeeds or fails
+     *
+     *  The callback is executed on the loop the connections are bound to.
+     *
+     *  @param  index       index of the loop
+     *  @param  callback    the callback that will be informed of the connection status
+     */
+    void onConnected(size_t index, const std::function<void(const char *error)>& callback);
+
+    /**
+     *  Get the next connection of a loop
+     *
+     *  The connections of a loop are handed out in turn, so that their
+     *  workers share the load. This may only be called from the thread
+     *  running the loop, and the operations started on the connection
+     *  report their results on that loop.
+     *
+     *  @param  index       index of the loop
+     *  @return Connection
+     */
+    Connection& connection(size_t index)
+    {
+        // the connections of the loop
+        auto &shard = *_shards[index];
+
+        // take the next one in turn
+        auto &result = *shard.connections[shard.next];
+        if (++shard.next == shard.connections.size()) shard.next = 0;
+
+        // done
+        return result;
+    }
+
+    /**
+     *  Get the next connection of a loop
+     *
+     *  @param  loop        the loop to get a connection for
+     *  @return Connection
+     *  @throws std::invalid_argument   if the loop is not part of the pool
+     */
+    Connection& connection(React::Loop *loop);
+};
+
+/**
+ *  End namespace
+ */
+}}
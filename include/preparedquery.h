@@ -0,0 +1,110 @@
+/**
+ *  PreparedQuery.h
+ *
+ *  A query that has been converted to bson once, with
+ *  a number of parameter slots that can be filled in
+ *  for every execution without converting it again.
+ *
+ *  @copyright 2014 Copernica BV
+ */
+
+/**
+ *  Set up namespace
+ */
+namespace React { namespace Mongo {
+
+/**
+ *  PreparedQuery class
+ */
+class PreparedQuery
+{
+private:
+    /**
+     *  A slot in the encoded query that is
+     *  replaced by a parameter on execution
+     */
+    struct Slot
+    {
+        /**
+         *  Index of the parameter that goes in the slot
+         */
+        size_t parameter;
+
+        /**
+         *  Offset of the value in the encoded query
+         */
+        size_t offset;
+
+        /**
+         *  Number of bytes the value occupies in the template
+         */
+        size_t size;
+
+        /**
+         *  The bson type of the value
+         */
+        mongo::BSONType type;
+
+        /**
+         *  Offsets of all the documents holding the value,
+         *  their length headers need updating when the
+         *  size of the value changes
+         */
+        std::vector<size_t> parents;
+    };
+
+    /**
+     *  The encoded query template
+     */
+    mongo::BSONObj _template;
+
+    /**
+     *  The slots, ordered by their offset in the template
+     */
+    std::shared_ptr<const std::vector<Slot>> _slots;
+public:
+    /**
+     *  Constructor
+     *
+     *  The parameters are given as dotted paths into the query, for example
+     *  "_id" or "age.$gt". The value found at that path in the template
+     *  determines the type of the parameter. Supported are integers, doubles,
+     *  booleans and strings. A path that cannot be found or that points to
+     *  a value of another type causes a std::invalid_argument to be thrown.
+     *  Every value can only be a single parameter, the same path given
+     *  twice, or a path inside another one, is rejected in the same way.
+     *
+     *  @param  query       the encoded query template
+     *  @param  parameters  the paths of the parameters in the query
+     */
+    PreparedQuery(const mongo::BSONObj& query, const std::vector<std::string>& parameters);
+
+    /**
+     *  Number of parameters expected when executing
+     *
+     *  @return size_t
+     */
+    size_t parameters() const
+    {
+        return _slots->size();
+    }
+
+    /**
+     *  Fill in the parameters and write the resulting
+     *  bson query to the given buffer.
+     *
+     *  The template bytes are copied as-is, only the bytes of the
+     *  parameters are written, after which the length headers of
+     *  the documents holding a string parameter are updated.
+     *
+     *  @param  values      the parameter values, in the order of the paths given to the constructor
+     *  @param  buffer      the buffer to write the encoded query to
+     *  @return bool        false if the wrong number of values was given
+     */
+    bool bind(const std::vector<Variant::Value>& values, std::string& buffer) const;
+};
+
+/**
+ *  End namespace
+ */
+}}
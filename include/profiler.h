@@ -0,0 +1,334 @@
+/**
+ *  Profiler.h
+ *
+ *  Classes to measure how long queries take, and to report
+ *  the ones that take longer than a threshold.
+ *
+ *  @copyright 2014 Copernica BV
+ */
+
+/**
+ *  Set up namespace
+ */
+namespace React { namespace Mongo {
+
+/**
+ *  Description of a query that took longer than the threshold,
+ *  all durations are in milliseconds
+ */
+class SlowOperation
+{
+public:
+    /**
+     *  Database name and collection
+     */
+    std::string collection;
+
+    /**
+     *  The query with all values replaced by question marks,
+     *  for example { age: { $gt: ? }, tags: { $in: [?] } }
+     */
+    std::string shape;
+
+    /**
+     *  Time the query waited for the worker
+     */
+    double queued = 0.0;
+
+    /**
+     *  Time until the first batch was received, this is spent
+     *  on planning and running the query, and on the network
+     */
+    double server = 0.0;
+
+    /**
+     *  Time spent on receiving the other batches
+     */
+    double fetch = 0.0;
+
+    /**
+     *  Time spent on converting the documents
+     */
+    double convert = 0.0;
+
+    /**
+     *  Total time from the call until the result was ready
+     */
+    double total = 0.0;
+
+    /**
+     *  Number of documents and bytes received
+     */
+    size_t documents = 0;
+    size_t bytes = 0;
+
+    /**
+     *  Number of slow queries seen with this shape, including this one,
+     *  only the thousand most recently slow shapes are remembered
+     */
+    size_t occurrences = 0;
+
+    /**
+     *  The query plan of this shape, when explain sampling is enabled,
+     *  a shape is explained once, the first time it is slow
+     */
+    Variant::Value explain;
+};
+
+/**
+ *  Profiler class
+ */
+class Profiler
+{
+public:
+    /**
+     *  The clock used for all measurements
+     */
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     *  Timings of a single query, filled in by the worker
+     */
+    class Measurement
+    {
+    private:
+        /**
+         *  Are we measuring at all?
+         */
+        bool _active;
+
+        /**
+         *  When the query was started, and the end of the previous phase
+         */
+        Clock::time_point _submitted;
+        Clock::time_point _last;
+
+        /**
+         *  Milliseconds between two points in time
+         *
+         *  @param  from        the start
+         *  @param  to          the end
+         *  @return double
+         */
+        static double elapsed(Clock::time_point from, Clock::time_point to)
+        {
+            return std::chrono::duration<double, std::milli>(to - from).count();
+        }
+    public:
+        /**
+         *  Duration of the phases and the received data
+         */
+        double queued = 0.0;
+        double server = 0.0;
+        double fetch = 0.0;
+        double convert = 0.0;
+        size_t documents = 0;
+        size_t bytes = 0;
+
+        /**
+         *  Constructor, this is called when the worker starts the query
+         *
+         *  @param  active      are we measuring at all?
+         *  @param  submitted   when the query was started on the event loop
+         */
+        Measurement(bool active, Clock::time_point submitted) : _active(active), _submitted(submitted)
+        {
+            // nothing to do if we're not measuring
+            if (!_active) return;
+
+            // the query waited until now
+            _last = Clock::now();
+            queued = elapsed(_submitted, _last);
+        }
+
+        /**
+         *  Add the time since the end of the previous phase to a phase
+         *
+         *  @param  phase       the phase to add to
+         */
+        void lap(double &phase)
+        {
+            // nothing to do if we're not measuring
+            if (!_active) return;
+
+            // add the time and start the next phase
+            auto now = Clock::now();
+            phase += elapsed(_last, now);
+            _last = now;
+        }
+
+        /**
+         *  Count a received document
+         *
+         *  @param  document    the document received
+         */
+        void receive(const mongo::BSONObj &document)
+        {
+            documents += 1;
+            bytes += document.objsize();
+        }
+
+        /**
+         *  Are we measuring?
+         *
+         *  @return bool
+         */
+        bool active() const
+        {
+            return _active;
+        }
+
+        /**
+         *  Total time since the query was started
+         *
+         *  @return double
+         */
+        double total() const
+        {
+            return _active ? elapsed(_submitted, _last) : 0.0;
+        }
+    };
+
+private:
+    /**
+     *  Worker to call the callback on the event loop
+     */
+    React::Worker _master;
+
+    /**
+     *  The threshold in milliseconds, negative when disabled
+     */
+    std::atomic<double> _threshold;
+
+    /**
+     *  Should slow shapes be explained?
+     */
+    std::atomic<bool> _explain;
+
+    /**
+     *  The callback for slow operations, only used on the event loop
+     */
+    std::function<void(const SlowOperation&)> _callback;
+
+    /**
+     *  What we know about a shape, only used by the worker
+     */
+    struct Shape
+    {
+        size_t occurrences = 0;
+        bool explained = false;
+        Variant::Value explain;
+        std::list<std::string>::iterator recent;
+    };
+
+    /**
+     *  Maximum number of shapes we remember, the ones that were
+     *  not slow for the longest time are forgotten first
+     */
+    static const size_t maxShapes = 1000;
+
+    /**
+     *  The shapes that were slow, by their description
+     */
+    std::map<std::string, Shape> _shapes;
+
+    /**
+     *  The descriptions of the shapes, the most recently slow first
+     */
+    std::list<std::string> _recent;
+
+    /**
+     *  Find a shape, or add it when it is not known, and mark it
+     *  as the most recently used one
+     *
+     *  @param  description the description of the shape
+     *  @return Shape
+     */
+    Shape &find(const std::string& description);
+
+    /**
+     *  Describe an object without its values
+     *
+     *  @param  object      the object to describe
+     *  @param  result      the string to append to
+     */
+    static void describe(const mongo::BSONObj &object, std::string &result);
+
+public:
+    /**
+     *  Constructor
+     *
+     *  @param  loop        the loop to call the callback on
+     */
+    Profiler(React::Loop *loop) : _master(loop), _threshold(-1.0), _explain(false) {}
+
+    /**
+     *  Set the threshold and the callback, this is called from the event loop
+     *
+     *  @param  threshold   threshold in milliseconds
+     *  @param  callback    the callback, or an empty function to stop profiling
+     *  @param  explain     should slow shapes be explained?
+     */
+    void set(double threshold, const std::function<void(const SlowOperation&)>& callback, bool explain);
+
+    /**
+     *  Start measuring a query, this is called from the worker
+     *
+     *  @param  submitted   when the query was started on the event loop
+     *  @return Measurement
+     */
+    Measurement start(Clock::time_point submitted) const
+    {
+        return Measurement(_threshold >= 0.0, submitted);
+    }
+
+    /**
+     *  Is a finished measurement slow enough to be reported?
+     *
+     *  @param  measurement the measurement to check
+     *  @return bool
+     */
+    bool slow(const Measurement& measurement) const
+    {
+        return measurement.active() && measurement.total() >= _threshold;
+    }
+
+    /**
+     *  Add a slow operation to the statistics of its shape, this is
+     *  called from the worker, and fills in the number of occurrences
+     *  and the plan if the shape was explained before
+     *
+     *  @param  operation   the slow operation
+     *  @return bool        true if the shape should be explained now
+     */
+    bool record(SlowOperation& operation);
+
+    /**
+     *  Store the plan of a shape, this is called from the worker
+     *
+     *  @param  shape       the shape that was explained
+     *  @param  plan        the plan of the shape
+     */
+    void explained(const std::string& shape, const Variant::Value& plan);
+
+    /**
+     *  Pass a slow operation to the callback on the event loop
+     *
+     *  @param  operation   the slow operation
+     */
+    void report(std::shared_ptr<SlowOperation>&& operation);
+
+    /**
+     *  Describe a query without its values, so that queries that
+     *  differ only in their values have the same shape
+     *
+     *  @param  query       the query to describe
+     *  @return std::string
+     */
+    static std::string shape(const mongo::BSONObj& query);
+};
+
+/**
+ *  End namespace
+ */
+}}
@@ -0,0 +1,76 @@
+/**
+ *  Resolver.h
+ *
+ *  Class connecting to a host. The driver only tries the first
+ *  address of a host name, so when that fails and the host has
+ *  multiple addresses, they are tried in parallel, with a short
+ *  delay between the attempts, and the first one that accepts the
+ *  connection is used. That address is remembered for a minute, so
+ *  that the other connections to the same host, for example those
+ *  in a pool, do not have to wait for the broken address again.
+ *
+ *  @copyright 2014 Copernica BV
+ */
+
+/**
+ *  Set up namespace
+ */
+namespace React { namespace Mongo {
+
+/**
+ *  Resolver class
+ */
+class Resolver
+{
+private:
+    /**
+     *  Try to connect to all addresses, and return the first that accepts
+     *
+     *  @param  addresses   the addresses of the host
+     *  @param  delay       milliseconds to wait before the next address is tried
+     *  @return the address, or a null pointer if none accepted
+     */
+    static const struct addrinfo *race(const struct addrinfo *addresses, int delay);
+
+    /**
+     *  Find the address that accepts connections first
+     *
+     *  @param  host        host name, optionally followed by a colon and the port
+     *  @return the numeric address and port, or an empty string if none accepted
+     */
+    static std::string lookup(const std::string& host);
+
+    /**
+     *  The remembered address of a host
+     *
+     *  @param  host        host name, optionally followed by a colon and the port
+     *  @return the numeric address and port, or an empty string if there is none
+     */
+    static std::string remembered(const std::string& host);
+public:
+    /**
+     *  Connect to a host
+     *
+     *  A remembered address is used first. Otherwise the driver connects
+     *  to the host name as usual, and only when that fails, all addresses
+     *  of the host are tried at once. This blocks until connected, and
+     *  must therefore be called from a worker thread.
+     *
+     *  @param  connection  the connection to connect
+     *  @param  host        host name, optionally followed by a colon and the port
+     *  @throws mongo::DBException  if the host could not be reached
+     */
+    static void connect(mongo::DBClientConnection& connection, const std::string& host);
+
+    /**
+     *  Forget the address of a host, after connecting to it failed
+     *
+     *  @param  host        host name, optionally followed by a colon and the port
+     */
+    static void forget(const std::string& host);
+};
+
+/**
+ *  End namespace
+ */
+}}
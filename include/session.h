@@ -0,0 +1,312 @@
+/**
+ *  Session.h
+ *
+ *  A logical session on a connection, for causally consistent
+ *  reads and for multi-document transactions. All operations
+ *  in a session run as commands on the connection's worker,
+ *  in the order in which they were started.
+ *
+ *  @copyright 2014 Copernica BV
+ */
+
+/**
+ *  Set up namespace
+ */
+namespace React { namespace Mongo {
+
+/**
+ *  Session class
+ */
+class Session
+{
+private:
+    /**
+     *  A write in a transaction that was not yet sent to the server
+     */
+    struct Write
+    {
+        /**
+         *  Database name and collection
+         */
+        std::string collection;
+
+        /**
+         *  The command and the name of its list of operations,
+         *  like "insert" and "documents"
+         */
+        const char *command;
+        const char *list;
+
+        /**
+         *  The document, update or delete statement
+         */
+        mongo::BSONObj operation;
+
+        /**
+         *  The deferred to report to when the write was sent
+         */
+        std::shared_ptr<Deferred<>> deferred;
+    };
+
+    /**
+     *  The connection we belong to
+     */
+    Connection *_connection;
+
+    /**
+     *  Should reads see the results of earlier operations in the session?
+     */
+    bool _causal;
+
+    /**
+     *  Is a transaction open, as seen by the event loop
+     */
+    bool _transaction = false;
+
+    /**
+     *  The session id, the worker adds it to every command
+     */
+    mongo::BSONObj _id;
+
+    /**
+     *  The number of the current transaction
+     */
+    long long _number = 0;
+
+    /**
+     *  Is a transaction open, as seen by the worker
+     */
+    bool _active = false;
+
+    /**
+     *  Has the current transaction been started on the server?
+     */
+    bool _started = false;
+
+    /**
+     *  The error of the current transaction, if a write in it failed
+     */
+    std::string _error;
+
+    /**
+     *  The writes in the current transaction that were not yet sent,
+     *  they are sent together when the transaction is committed or
+     *  when a query in the transaction needs to see them
+     */
+    std::vector<Write> _writes;
+
+    /**
+     *  The operation time of the last reply, for causally consistent
+     *  reads, stored as a read concern: { afterClusterTime: time }
+     */
+    mongo::BSONObj _readConcern;
+
+    /**
+     *  The last cluster time we saw, it is passed on to the server
+     */
+    mongo::BSONObj _clusterTime;
+
+    /**
+     *  Constructor
+     *
+     *  @param  connection  the connection we belong to
+     *  @param  causal      should reads see the results of earlier operations?
+     */
+    Session(Connection *connection, bool causal);
+
+    /**
+     *  The database and collection name parts of a namespace
+     *
+     *  @param  collection  database name and collection
+     */
+    static std::string database(const std::string& collection);
+    static std::string collection(const std::string& collection);
+
+    /**
+     *  Add the session fields to a command and run it, this is called
+     *  from the worker, it throws if the command or a write in it failed
+     *
+     *  @param  database    the database to run the command on
+     *  @param  command     the command, without the session fields
+     *  @param  read        is this the first command of a read?
+     *  @return mongo::BSONObj  the reply
+     */
+    mongo::BSONObj run(const std::string& database, mongo::BSONObjBuilder& command, bool read);
+
+    /**
+     *  Send all writes of the transaction that were not yet sent, this is
+     *  called from the worker, consecutive writes of the same kind on the
+     *  same collection are sent as a single command
+     */
+    void flush();
+
+    /**
+     *  Run a write, or add it to the transaction when one is open
+     *
+     *  @param  collection  database name and collection
+     *  @param  command     the write command, like "insert"
+     *  @param  list        the name of its list of operations, like "documents"
+     *  @param  operation   function that encodes the operation in the worker
+     *  @return the deferred handler
+     */
+    Deferred<>& write(const std::string& collection, const char *command, const char *list, std::function<mongo::BSONObj()>&& operation);
+public:
+    /**
+     *  We cannot be copied
+     */
+    Session(const Session& that) = delete;
+
+    /**
+     *  Nor can we be moved
+     */
+    Session(Session&& that) = delete;
+
+    /**
+     *  Start a transaction
+     *
+     *  The queries and writes that are started after this call are part of
+     *  the transaction, until commit() or abort() is called. The writes are
+     *  collected and sent together, so their deferreds are called when the
+     *  transaction is committed, or when a query in the transaction needs
+     *  to see them. Whether the writes are permanent is only known once the
+     *  deferred of the commit is called.
+     *
+     *  @return the same session
+     */
+    Session& startTransaction();
+
+    /**
+     *  Is a transaction open?
+     *
+     *  @return bool
+     */
+    bool inTransaction() const
+    {
+        return _transaction;
+    }
+
+    /**
+     *  Commit the transaction
+     *
+     *  The remaining writes and the commit are sent in one go, without
+     *  returning to the event loop in between. If a write failed, the
+     *  transaction was aborted and the commit fails as well.
+     *
+     *  @param  concern     the write concern to wait for
+     *  @return the deferred handler
+     */
+    DeferredCommit& commit(const WriteConcern& concern = WriteConcern());
+
+    /**
+     *  Abort the transaction, the writes that were not yet
+     *  sent are dropped and their deferreds are not called
+     *
+     *  @return the deferred handler
+     */
+    DeferredAbort& abort();
+
+    /**
+     *  Query a collection
+     *
+     *  @param  collection  database name and collection
+     *  @param  query       the query to execute
+     */
+    DeferredQuery& query(const std::string& collection, Variant::Value&& query);
+
+    /**
+     *  Query a collection
+     *
+     *  Note:   This function will make a copy of the query object. This
+     *          can be useful when you want to reuse the given query object,
+     *          otherwise it is best to pass in an rvalue and avoid the copy.
+     *
+     *  @param  collection  database name and collection
+     *  @param  query       the query to execute
+     */
+    DeferredQuery& query(const std::string& collection, const Variant::Value& query);
+
+    /**
+     *  Insert a document into a collection
+     *
+     *  @param  collection  database name and collection
+     *  @param  document    document to insert
+     */
+    DeferredInsert& insert(const std::string& collection, Variant::Value&& document);
+
+    /**
+     *  Insert a document into a collection
+     *
+     *  Note:   This function will make a copy of the document object. This
+     *          can be useful when you want to reuse the given document object,
+     *          otherwise it is best to pass in an rvalue and avoid the copy.
+     *
+     *  @param  collection  database name and collection
+     *  @param  document    document to insert
+     */
+    DeferredInsert& insert(const std::string& collection, const Variant::Value& document);
+
+    /**
+     *  Update an existing document in a collection
+     *
+     *  @param  collection  collection keeping the document to be updated
+     *  @param  query       the query to find the document(s) to update
+     *  @param  document    the new document to replace existing document with
+     *  @param  upsert      if no matching document was found, create one instead
+     *  @param  multi       if multiple matching documents are found, update them all
+     */
+    DeferredUpdate& update(const std::string& collection, Variant::Value&& query, Variant::Value&& document, bool upsert = false, bool multi = false);
+
+    /**
+     *  Update an existing document in a collection
+     *
+     *  Note:   This function will make a copy of the query and document object.
+     *          This can be useful when you want to reuse the given document object,
+     *          otherwise it is best to pass in an rvalue and avoid the copy.
+     *
+     *  @param  collection  collection keeping the document to be updated
+     *  @param  query       the query to find the document(s) to update
+     *  @param  document    the new document to replace existing document with
+     *  @param  upsert      if no matching document was found, create one instead
+     *  @param  multi       if multiple matching documents are found, update them all
+     */
+    DeferredUpdate& update(const std::string& collection, const Variant::Value& query, const Variant::Value& document, bool upsert = false, bool multi = false);
+
+    /**
+     *  Remove one or more existing documents from a collection
+     *
+     *  @param  collection  collection holding the document(s) to be removed
+     *  @param  query       the query to find the document(s) to remove
+     *  @param  limitToOne  limit the removal to a single document
+     */
+    DeferredRemove& remove(const std::string& collection, Variant::Value&& query, bool limitToOne = false);
+
+    /**
+     *  Remove one or more existing documents from a collection
+     *
+     *  Note:   This function will make a copy of the query object.
+     *          This can be useful when you want to reuse the given query object,
+     *          otherwise it is best to pass in an rvalue and avoid the copy.
+     *
+     *  @param  collection  collection holding the document(s) to be removed
+     *  @param  query       the query to find the document(s) to remove
+     *  @param  limitToOne  limit the removal to a single document
+     */
+    DeferredRemove& remove(const std::string& collection, const Variant::Value& query, bool limitToOne = false);
+
+    /**
+     *  End the session
+     *
+     *  An open transaction is aborted. The session object is destroyed
+     *  by the connection once the operations that were already started
+     *  are finished, so it may not be used after it was ended.
+     */
+    void end();
+
+    // the connection creates the sessions
+    friend class Connection;
+};
+
+/**
+ *  End namespace
+ */
+}}
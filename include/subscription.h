@@ -0,0 +1,221 @@
+/**
+ *  Subscription.h
+ *
+ *  A subscription on a tailable cursor or on a change stream.
+ *  New documents or change events are pushed to the callback
+ *  on the event loop as soon as they become available.
+ *
+ *  @copyright 2014 Copernica BV
+ */
+
+/**
+ *  Set up namespace
+ */
+namespace React { namespace Mongo {
+
+/**
+ *  Subscription class
+ */
+class Subscription
+{
+private:
+    /**
+     *  The connection we belong to
+     */
+    Connection *_connection;
+
+    /**
+     *  Our own connection to mongo, which reconnects
+     *  automatically when the connection is lost
+     */
+    mongo::DBClientConnection _mongo;
+
+    /**
+     *  Database name and collection
+     */
+    std::string _collection;
+
+    /**
+     *  The query to tail or the pipeline to watch
+     */
+    mongo::BSONObj _query;
+
+    /**
+     *  Are we watching a change stream (or tailing a cursor)?
+     */
+    bool _watch;
+
+    /**
+     *  Are we connected yet? The worker connects on its first
+     *  run, and retries if that failed
+     */
+    bool _connected = false;
+
+    /**
+     *  The tailable cursor
+     */
+    std::unique_ptr<mongo::DBClientCursor> _cursor;
+
+    /**
+     *  The id of the change stream cursor
+     */
+    long long _cursorId = 0;
+
+    /**
+     *  Position up to which we received data, this is used
+     *  by the worker to continue after a failure. For change
+     *  streams this is the resume token, for tailable cursors
+     *  this holds the _id of the last document.
+     */
+    mongo::BSONObj _position;
+
+    /**
+     *  Position of the last data delivered to the callback,
+     *  this is only accessed from the event loop.
+     */
+    mongo::BSONObj _token;
+
+    /**
+     *  Has the subscription been cancelled? This is shared with the
+     *  callbacks posted to the event loop, so that they can check it
+     *  after the subscription was destroyed.
+     */
+    std::shared_ptr<std::atomic<bool>> _cancelled;
+
+    /**
+     *  Callback to execute for each document
+     */
+    std::function<void(Variant::Value&& document)> _dataCallback;
+
+    /**
+     *  Callback to execute on failure
+     */
+    std::function<void(const char *error)> _failureCallback;
+
+    /**
+     *  The worker waiting for new data, this is a separate thread so that
+     *  waiting does not block other operations. It is declared last, so
+     *  that it is stopped before the members it uses are destroyed.
+     */
+    React::Worker _worker;
+
+    /**
+     *  Constructor
+     *
+     *  @param  connection  the connection we belong to
+     *  @param  collection  database name and collection
+     *  @param  query       the query to tail, or the pipeline to watch
+     *  @param  watch       watch a change stream instead of tailing a cursor
+     *  @param  token       resume token to continue from (change streams only)
+     */
+    Subscription(Connection *connection, const std::string& collection, mongo::BSONObj&& query, bool watch, mongo::BSONObj&& token);
+
+    /**
+     *  The database and collection name parts of the namespace
+     */
+    std::string database() const;
+    std::string collection() const;
+
+    /**
+     *  Retrieve the next batch from the tailable cursor
+     *
+     *  @param  documents   vector to add the documents to
+     */
+    void tail(std::vector<mongo::BSONObj>& documents);
+
+    /**
+     *  Retrieve the next batch from the change stream
+     *
+     *  @param  documents   vector to add the change events to
+     */
+    void watch(std::vector<mongo::BSONObj>& documents);
+
+    /**
+     *  Kill the cursor on the server, it is reopened on the next run
+     */
+    void close();
+
+    /**
+     *  Wait for the next batch and schedule the next run,
+     *  this is executed in our own worker thread.
+     */
+    void run();
+public:
+    /**
+     *  We cannot be copied
+     */
+    Subscription(const Subscription& that) = delete;
+
+    /**
+     *  Nor can we be moved
+     */
+    Subscription(Subscription&& that) = delete;
+
+    /**
+     *  Destructor
+     */
+    ~Subscription();
+
+    /**
+     *  Register a callback to be executed for every new
+     *  document or change event
+     *
+     *  @param  callback    the callback to execute
+     */
+    Subscription& onData(const std::function<void(Variant::Value&& document)>& callback)
+    {
+        // store callback
+        _dataCallback = callback;
+        return *this;
+    }
+
+    /**
+     *  Register a callback to be executed when retrieving data
+     *  failed. The subscription is not cancelled on failure,
+     *  it is reopened from the last received position instead.
+     *
+     *  @param  callback    the callback to execute on failure
+     */
+    Subscription& onFailure(const std::function<void(const char *error)>& callback)
+    {
+        // store callback
+        _failureCallback = callback;
+        return *this;
+    }
+
+    /**
+     *  The position of the last delivered data. For change streams this is
+     *  the resume token, which can be passed to Connection::watch() to continue
+     *  where a previous subscription left off. The token is kept in its bson
+     *  form, because it may hold types like binary data that a Variant cannot
+     *  represent. To store it, save the objsize() bytes at objdata(), and
+     *  restore it with mongo::BSONObj(data).getOwned().
+     *
+     *  @return mongo::BSONObj
+     */
+    const mongo::BSONObj& token() const
+    {
+        return _token;
+    }
+
+    /**
+     *  Stop receiving data
+     *
+     *  No callbacks are executed after this call. The subscription
+     *  object is destroyed by the connection once the worker has
+     *  stopped, so it may not be used after it was cancelled.
+     */
+    void cancel()
+    {
+        // mark as cancelled, the worker picks this up
+        *_cancelled = true;
+    }
+
+    // the connection class may call private methods
+    friend class Connection;
+};
+
+/**
+ *  End namespace
+ */
+}}
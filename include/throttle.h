@@ -0,0 +1,155 @@
+/**
+ *  Throttle.h
+ *
+ *  Class limiting the number of operations and documents
+ *  that are queued for or in progress in the worker.
+ *
+ *  @copyright 2014 Copernica BV
+ */
+
+/**
+ *  Set up namespace
+ */
+namespace React { namespace Mongo {
+
+/**
+ *  What to do when a new operation would exceed the limits
+ */
+enum class Overload
+{
+    /**
+     *  Reject the operation, its failure callback is called
+     */
+    Fail,
+
+    /**
+     *  Block the caller until enough operations are finished
+     */
+    Block,
+
+    /**
+     *  Accept the operation, but call the overload callback so
+     *  that the caller can stop producing new operations until
+     *  the drained callback is called
+     */
+    Notify
+};
+
+/**
+ *  Throttle class
+ */
+class Throttle
+{
+private:
+    /**
+     *  Worker to call the callbacks on the event loop
+     */
+    React::Worker _master;
+
+    /**
+     *  Maximum number of pending operations and documents, zero for no limit
+     */
+    size_t _operations = 0;
+    size_t _documents = 0;
+
+    /**
+     *  What to do when the limits are reached
+     */
+    Overload _policy = Overload::Fail;
+
+    /**
+     *  Number of pending operations and documents
+     */
+    size_t _pendingOperations = 0;
+    size_t _pendingDocuments = 0;
+
+    /**
+     *  Have we reported an overload that has not yet drained?
+     */
+    bool _overloaded = false;
+
+    /**
+     *  Mutex protecting the counters, the operations are
+     *  added on the event loop and removed by the worker
+     */
+    std::mutex _mutex;
+
+    /**
+     *  Condition to wait for when blocking
+     */
+    std::condition_variable _condition;
+
+    /**
+     *  Callbacks for overload and drain notifications
+     */
+    std::function<void()> _overloadCallback;
+    std::function<void()> _drainedCallback;
+
+    /**
+     *  Would an operation with the given number of documents exceed the limits?
+     *
+     *  @param  documents   number of documents in the operation
+     *  @return bool
+     */
+    bool exceeds(size_t documents) const
+    {
+        // check both limits
+        if (_operations > 0 && _pendingOperations + 1 > _operations) return true;
+        if (_documents > 0 && _pendingDocuments > 0 && _pendingDocuments + documents > _documents) return true;
+
+        // still within limits
+        return false;
+    }
+public:
+    /**
+     *  Constructor
+     *
+     *  @param  loop        the loop to call the callbacks on
+     */
+    Throttle(React::Loop *loop) : _master(loop) {}
+
+    /**
+     *  Set the limits
+     *
+     *  Batch inserts count as a single operation with multiple documents,
+     *  all other operations count as one operation with one document.
+     *  An operation that has more documents than the limit by itself is
+     *  accepted as soon as no other operations are pending.
+     *
+     *  @param  operations  maximum number of pending operations, zero for no limit
+     *  @param  documents   maximum number of pending documents, zero for no limit
+     *  @param  policy      what to do when the limits are reached
+     */
+    void set(size_t operations, size_t documents, Overload policy);
+
+    /**
+     *  Register the callbacks for the notify policy, the overload
+     *  callback is called when the limits are exceeded, the drained
+     *  callback when the pending operations dropped below half the
+     *  limits again.
+     *
+     *  @param  callback    the callback to execute
+     */
+    void onOverload(const std::function<void()>& callback) { _overloadCallback = callback; }
+    void onDrained(const std::function<void()>& callback) { _drainedCallback = callback; }
+
+    /**
+     *  Add an operation, this is called from the event loop
+     *
+     *  @param  documents   number of documents in the operation
+     *  @return bool        false if the operation must be rejected
+     */
+    bool acquire(size_t documents);
+
+    /**
+     *  Remove a finished operation, this is called from the worker
+     *
+     *  @param  documents   number of documents in the operation
+     */
+    void release(size_t documents);
+};
+
+/**
+ *  End namespace
+ */
+}}
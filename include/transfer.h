@@ -0,0 +1,224 @@
+/**
+ *  Transfer.h
+ *
+ *  Class to copy whole collections, to another server or to a file,
+ *  and to load them from a file again. The documents are passed on
+ *  as bson, without being converted, and are read and written over
+ *  multiple connections in parallel.
+ *
+ *  @copyright 2014 Copernica BV
+ */
+
+/**
+ *  Set up namespace
+ */
+namespace React { namespace Mongo {
+
+/**
+ *  The formats of the files
+ */
+enum class Format
+{
+    /**
+     *  The bson documents one after another, like mongodump writes them
+     */
+    Bson,
+
+    /**
+     *  One document per line, in extended json
+     */
+    Json
+};
+
+/**
+ *  Transfer class
+ */
+class Transfer
+{
+private:
+    /**
+     *  A worker thread with its own connection to mongo,
+     *  so that documents can be transferred in parallel
+     */
+    struct Channel
+    {
+        /**
+         *  The connection used by the worker
+         */
+        mongo::DBClientConnection mongo;
+
+        /**
+         *  The connection to the server we copy to, and its host
+         */
+        std::unique_ptr<mongo::DBClientConnection> target;
+        std::string host;
+
+        /**
+         *  Buffer to encode documents in before they are written to a file
+         */
+        std::string buffer;
+
+        /**
+         *  The worker running the transfers, it is declared last so
+         *  that it is stopped before the connections are destroyed
+         */
+        React::Worker worker;
+
+        /**
+         *  Constructor, the connection reconnects automatically
+         */
+        Channel() : mongo(true) {}
+    };
+
+    /**
+     *  The state of a transfer, shared by all channels
+     */
+    struct Progress
+    {
+        /**
+         *  Number of jobs that are not yet finished
+         */
+        std::atomic<size_t> pending;
+
+        /**
+         *  Number of documents transferred
+         */
+        std::atomic<size_t> documents;
+
+        /**
+         *  Mutex protecting the other members, and the output file
+         */
+        std::mutex mutex;
+
+        /**
+         *  The first error that occured
+         */
+        std::string error;
+
+        /**
+         *  Number of batches read from a file that are not yet inserted,
+         *  and the condition to wait for when there are too many
+         */
+        size_t batches = 0;
+        std::condition_variable condition;
+
+        /**
+         *  Constructor
+         */
+        Progress() : pending(0), documents(0) {}
+    };
+
+    /**
+     *  Function that passes on a batch of documents
+     */
+    using Sink = std::function<void(Channel *channel, const std::vector<mongo::BSONObj>& documents, Progress& progress)>;
+
+    /**
+     *  The connection we belong to
+     */
+    Connection *_connection;
+
+    /**
+     *  The channels to transfer data over
+     */
+    std::vector<std::unique_ptr<Channel>> _channels;
+
+    /**
+     *  Maximum number of documents passed on at once
+     */
+    size_t _batch;
+
+    /**
+     *  Divide a collection in ranges of _id values of about the same size
+     *
+     *  @param  channel     the channel to use
+     *  @param  collection  database name and collection
+     *  @return std::vector the boundaries between the ranges
+     */
+    std::vector<mongo::BSONObj> split(Channel *channel, const std::string& collection);
+
+    /**
+     *  Read a whole collection over all channels, and pass the documents on
+     *
+     *  @param  collection  database name and collection
+     *  @param  sink        function that passes on a batch of documents
+     *  @return the deferred handler
+     */
+    DeferredTransfer& read(const std::string& collection, const Sink& sink);
+
+    /**
+     *  Mark a job of a transfer as finished, and report the
+     *  result when it was the last one
+     *
+     *  @param  progress    the state of the transfer
+     *  @param  deferred    the deferred to report to
+     */
+    void finish(const std::shared_ptr<Progress>& progress, const std::shared_ptr<DeferredTransfer>& deferred);
+public:
+    /**
+     *  Constructor
+     *
+     *  Every channel is a separate thread with its own connection to the
+     *  server. Collections are divided in as many ranges of _id values
+     *  as there are channels, and the ranges are read in parallel.
+     *
+     *  @param  connection  the connection to the server
+     *  @param  channels    number of parallel channels
+     *  @param  batch       maximum number of documents written at once
+     */
+    Transfer(Connection *connection, size_t channels = 4, size_t batch = 1000);
+
+    /**
+     *  We cannot be copied
+     */
+    Transfer(const Transfer& that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Transfer() {}
+
+    /**
+     *  Copy a collection to another server
+     *
+     *  On success, the number of documents copied is passed to the callback.
+     *
+     *  @param  source      database name and collection to copy
+     *  @param  host        the server to copy to
+     *  @param  target      database name and collection to copy to
+     */
+    DeferredTransfer& copy(const std::string& source, const std::string& host, const std::string& target);
+
+    /**
+     *  Write a collection to a file
+     *
+     *  The documents are written in the order in which they are received
+     *  by the channels. The file descriptor must remain open until the
+     *  operation completes. On success, the number of documents written
+     *  is passed to the callback.
+     *
+     *  @param  source      database name and collection to write
+     *  @param  fd          file descriptor to write to
+     *  @param  format      the format of the file
+     */
+    DeferredTransfer& dump(const std::string& source, int fd, Format format = Format::Bson);
+
+    /**
+     *  Insert the documents in a file into a collection
+     *
+     *  The file is read by the first channel, the other channels insert
+     *  the documents. The file descriptor must remain open until the
+     *  operation completes. On success, the number of documents inserted
+     *  is passed to the callback.
+     *
+     *  @param  fd          file descriptor to read from
+     *  @param  target      database name and collection to insert into
+     *  @param  format      the format of the file
+     */
+    DeferredTransfer& restore(int fd, const std::string& target, Format format = Format::Bson);
+};
+
+/**
+ *  End namespace
+ */
+}}
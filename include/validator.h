@@ -0,0 +1,88 @@
+/**
+ *  Validator.h
+ *
+ *  Class to check that encoded bson is well formed and that
+ *  all strings and field names in it are valid utf-8.
+ *
+ *  @copyright 2014 Copernica BV
+ */
+
+/**
+ *  Set up namespace
+ */
+namespace React { namespace Mongo {
+
+/**
+ *  Validator class
+ */
+class Validator
+{
+private:
+    /**
+     *  Check a document, and all documents nested in it
+     *
+     *  @param  data        the encoded document
+     *  @param  size        number of bytes available for the document
+     *  @param  depth       the nesting depth of the document
+     *  @return bool
+     */
+    static bool document(const char *data, size_t size, int depth);
+
+    /**
+     *  Check a length-prefixed string value
+     *
+     *  @param  data        the encoded string
+     *  @param  size        number of bytes available for the string
+     *  @return size_t      number of bytes used by the string, zero if invalid
+     */
+    static size_t string(const char *data, size_t size);
+
+    /**
+     *  Check a nul-terminated string, such as a field name
+     *
+     *  @param  data        the string
+     *  @param  size        number of bytes available for the string
+     *  @return size_t      number of bytes used by the string, zero if invalid
+     */
+    static size_t cstring(const char *data, size_t size);
+public:
+    /**
+     *  Check that a buffer holds valid utf-8
+     *
+     *  Runs of plain ascii are skipped with vector instructions when
+     *  the library is compiled with sse2 or avx2 support, only the
+     *  multi-byte sequences are decoded one at a time. The default
+     *  flags only enable sse2, build with "make SIMD=-mavx2" for avx2.
+     *
+     *  @param  data        the data to check
+     *  @param  size        size of the data
+     *  @return bool
+     */
+    static bool utf8(const char *data, size_t size);
+
+    /**
+     *  Check that a buffer holds a well formed bson document
+     *  with valid utf-8 in all its strings and field names
+     *
+     *  @param  data        the encoded document
+     *  @param  size        size of the buffer
+     *  @return bool
+     */
+    static bool validate(const char *data, size_t size);
+
+    /**
+     *  Check that a bson object is well formed
+     *
+     *  @param  object      the object to check
+     *  @return bool
+     */
+    static bool validate(const mongo::BSONObj& object)
+    {
+        return validate(object.objdata(), object.objsize());
+    }
+};
+
+/**
+ *  End namespace
+ */
+}}
@@ -0,0 +1,263 @@
+/**
+ *  WriteBehind.h
+ *
+ *  Buffer that collects updates of single documents, and merges
+ *  the updates of the same document, so that they can be sent to
+ *  the server as one update per document per interval.
+ *
+ *  Only updates that select a document by its _id, and that only
+ *  use the $inc, $max, $min and $set operators on top level fields
+ *  are collected. Two updates of the same field are merged if the
+ *  result of applying them one after the other can be expressed by
+ *  a single operator, otherwise the buffer is flushed first.
+ *
+ *  The buffer is only accessed from the event loop.
+ *
+ *  @copyright 2014 Copernica BV
+ */
+
+/**
+ *  Set up namespace
+ */
+namespace React { namespace Mongo {
+
+/**
+ *  WriteBehind class
+ */
+class WriteBehind
+{
+public:
+    /**
+     *  The supported update operators
+     */
+    enum class Operator { Inc, Max, Min, Set };
+
+    /**
+     *  The collected updates of a single field
+     */
+    struct Field
+    {
+        Operator op;
+        Variant::Value value;
+    };
+
+    /**
+     *  The collected updates of a single document
+     */
+    struct Entry
+    {
+        /**
+         *  Database name and collection
+         */
+        std::string collection;
+
+        /**
+         *  The _id of the document
+         */
+        Variant::Value id;
+
+        /**
+         *  The fields to update, by name
+         */
+        std::map<std::string, Field> fields;
+
+        /**
+         *  Should the document be created if it does not exist?
+         */
+        bool upsert = false;
+
+        /**
+         *  The deferreds of the collected updates
+         */
+        std::vector<std::shared_ptr<DeferredUpdate>> deferreds;
+
+        /**
+         *  The query selecting the document
+         *
+         *  @return Variant::Value
+         */
+        Variant::Value query() const;
+
+        /**
+         *  The update to send
+         *
+         *  @return Variant::Value
+         */
+        Variant::Value update() const;
+    };
+
+    /**
+     *  The collected updates by collection and _id
+     */
+    using Batch = std::map<std::string, Entry>;
+
+private:
+    /**
+     *  The flush interval in seconds, zero when disabled
+     */
+    double _interval = 0.0;
+
+    /**
+     *  Is a flush scheduled?
+     */
+    bool _scheduled = false;
+
+    /**
+     *  The updates that were not yet sent
+     */
+    Batch _pending;
+
+    /**
+     *  The batches that are being sent, with their sequence numbers
+     */
+    std::deque<std::pair<size_t, std::shared_ptr<const Batch>>> _flushing;
+
+    /**
+     *  Number of batches that were taken
+     */
+    size_t _batches = 0;
+
+    /**
+     *  Build the key of a document
+     *
+     *  @param  collection  database name and collection
+     *  @param  id          the _id of the document
+     *  @param  key         string to store the key in
+     *  @return bool        false if the _id is not supported
+     */
+    static bool key(const std::string& collection, const Variant::Value& id, std::string& key);
+
+    /**
+     *  Merge an update of a field into the earlier updates
+     *
+     *  @param  field       the earlier updates
+     *  @param  op          the operator of the update
+     *  @param  value       the value of the update
+     *  @return bool        false if they cannot be merged
+     */
+    static bool merge(Field& field, Operator op, const Variant::Value& value);
+
+    /**
+     *  Apply the updates in a batch to query results
+     *
+     *  @param  batch       the updates to apply
+     *  @param  collection  database name and collection that was queried
+     *  @param  documents   the documents to update
+     */
+    static void apply(const Batch& batch, const std::string& collection, std::vector<Variant::Value>& documents);
+public:
+    /**
+     *  Set the flush interval
+     *
+     *  @param  interval    interval in seconds, zero to disable the buffer
+     */
+    void setInterval(double interval)
+    {
+        _interval = std::max(interval, 0.0);
+    }
+
+    /**
+     *  The flush interval in seconds, zero when disabled
+     *
+     *  @return double
+     */
+    double interval() const
+    {
+        return _interval;
+    }
+
+    /**
+     *  Are there updates for a collection that were not yet sent?
+     *
+     *  @param  collection  database name and collection
+     *  @return bool
+     */
+    bool pending(const std::string& collection) const;
+
+    /**
+     *  Add an update to the buffer
+     *
+     *  @param  collection  database name and collection
+     *  @param  query       the query selecting the document
+     *  @param  document    the update
+     *  @param  upsert      should the document be created if it does not exist?
+     *  @param  deferred    the deferred to report to when the update is sent
+     *  @return bool        false if the update cannot be merged with the updates in the buffer
+     */
+    bool add(const std::string& collection, const Variant::Value& query, const Variant::Value& document, bool upsert, const std::shared_ptr<DeferredUpdate>& deferred);
+
+    /**
+     *  Can an update be collected at all?
+     *
+     *  @param  query       the query selecting the document
+     *  @param  document    the update
+     *  @return bool
+     */
+    static bool supports(const Variant::Value& query, const Variant::Value& document);
+
+    /**
+     *  Mark a flush as scheduled
+     *
+     *  @return bool        false if one was already scheduled
+     */
+    bool schedule()
+    {
+        // was one scheduled already?
+        if (_scheduled) return false;
+
+        // it is now
+        return _scheduled = true;
+    }
+
+    /**
+     *  The scheduled flush is running
+     */
+    void unschedule()
+    {
+        _scheduled = false;
+    }
+
+    /**
+     *  Take the updates out of the buffer, to send them
+     *
+     *  The batch is remembered until finished() is called, so
+     *  that queries that already ran still see its updates.
+     *
+     *  @return the updates, or a null pointer if there are none
+     */
+    std::shared_ptr<const Batch> take();
+
+    /**
+     *  The oldest batch that was taken has been sent
+     */
+    void finished()
+    {
+        _flushing.pop_front();
+    }
+
+    /**
+     *  The sequence number of the next batch, queries remember this
+     *  when they are started, the batches taken after that were sent
+     *  after the query ran
+     *
+     *  @return size_t
+     */
+    size_t snapshot() const
+    {
+        return _batches;
+    }
+
+    /**
+     *  Apply the updates the server did not yet have when a query ran
+     *
+     *  @param  collection  database name and collection that was queried
+     *  @param  snapshot    the snapshot taken when the query was started
+     *  @param  documents   the documents to update
+     */
+    void apply(const std::string& collection, size_t snapshot, std::vector<Variant::Value>& documents) const;
+};
+
+/**
+ *  End namespace
+ */
+}}
@@ -0,0 +1,50 @@
+/**
+ *  WriteConcern.h
+ *
+ *  The acknowledgement to wait for after a write operation
+ *
+ *  @copyright 2014 Copernica BV
+ */
+
+/**
+ *  Set up namespace
+ */
+namespace React { namespace Mongo {
+
+/**
+ *  WriteConcern class
+ */
+class WriteConcern
+{
+public:
+    /**
+     *  Number of servers that must have applied the write,
+     *  zero uses the default of the server
+     */
+    int w;
+
+    /**
+     *  Must the write be committed to the journal?
+     */
+    bool journal;
+
+    /**
+     *  Number of milliseconds to wait for the servers, zero waits forever
+     */
+    int timeout;
+
+    /**
+     *  Constructor
+     *
+     *  @param  w           number of servers that must have applied the write
+     *  @param  journal     must the write be committed to the journal
+     *  @param  timeout     number of milliseconds to wait for the servers
+     */
+    WriteConcern(int w = 0, bool journal = false, int timeout = 0) :
+        w(w), journal(journal), timeout(timeout) {}
+};
+
+/**
+ *  End namespace
+ */
+}}
@@ -17,12 +17,39 @@
 #include <string>
 #include <vector>
 #include <functional>
+#include <memory>
+#include <list>
+#include <deque>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdio>
+#include <cstring>
 
 /**
  *  Other include files
  */
 #include <reactcpp/mongo/deferred.h>
+#include <reactcpp/mongo/writeconcern.h>
+#include <reactcpp/mongo/modifyoptions.h>
+#include <reactcpp/mongo/throttle.h>
+#include <reactcpp/mongo/profiler.h>
+#include <reactcpp/mongo/writebehind.h>
+#include <reactcpp/mongo/validator.h>
+#include <reactcpp/mongo/documents.h>
+#include <reactcpp/mongo/mapping.h>
+#include <reactcpp/mongo/preparedquery.h>
+#include <reactcpp/mongo/subscription.h>
+#include <reactcpp/mongo/session.h>
 #include <reactcpp/mongo/connection.h>
+#include <reactcpp/mongo/collection.h>
+#include <reactcpp/mongo/gridfs.h>
+#include <reactcpp/mongo/transfer.h>
+#include <reactcpp/mongo/pool.h>
 
 /**
  *  End if
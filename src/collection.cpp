@@ -0,0 +1,163 @@
+/**
+ *  Collection.cpp
+ *
+ *  Handle to a single collection on a connection. The handle
+ *  stores the namespace once and holds the default options
+ *  used for all operations run through it.
+ *
+ *  @copyright 2014 Copernica BV
+ */
+
+#include "includes.h"
+
+/**
+ *  Set up namespace
+ */
+namespace React { namespace Mongo {
+
+/**
+ *  Query the collection
+ *
+ *  @param  query       the query to execute
+ */
+DeferredQuery& Collection::query(Variant::Value&& query)
+{
+    // pass to the connection
+    return _connection->query(_name, std::move(query), _options);
+}
+
+/**
+ *  Query the collection
+ *
+ *  @param  query       the query to execute
+ */
+DeferredQuery& Collection::query(const Variant::Value& query)
+{
+    // move a copy to the implementation
+    return this->query(Variant::Value(query));
+}
+
+/**
+ *  Query the collection using a prepared query
+ *
+ *  @param  query       the prepared query to execute
+ *  @param  parameters  the values for the parameters in the query
+ */
+DeferredQuery& Collection::query(const PreparedQuery& query, std::vector<Variant::Value>&& parameters)
+{
+    // pass to the connection
+    return _connection->query(_name, query, std::move(parameters), _options);
+}
+
+/**
+ *  Query the collection using a prepared query
+ *
+ *  @param  query       the prepared query to execute
+ *  @param  parameters  the values for the parameters in the query
+ */
+DeferredQuery& Collection::query(const PreparedQuery& query, const std::vector<Variant::Value>& parameters)
+{
+    // move a copy to the implementation
+    return this->query(query, std::vector<Variant::Value>(parameters));
+}
+
+/**
+ *  Insert a document into the collection
+ *
+ *  @param  document    document to insert
+ */
+DeferredInsert& Collection::insert(Variant::Value&& document)
+{
+    // pass to the connection
+    return _connection->insert(_name, std::move(document), _concern);
+}
+
+/**
+ *  Insert a document into the collection
+ *
+ *  @param  document    document to insert
+ */
+DeferredInsert& Collection::insert(const Variant::Value& document)
+{
+    // move a copy to the implementation
+    return insert(Variant::Value(document));
+}
+
+/**
+ *  Insert a batch of documents into the collection
+ *
+ *  @param  documents   documents to insert
+ */
+DeferredInsert& Collection::insert(std::vector<Variant::Value>&& documents)
+{
+    // pass to the connection
+    return _connection->insert(_name, std::move(documents), _concern);
+}
+
+/**
+ *  Insert a batch of documents into the collection
+ *
+ *  @param  documents   documents to insert
+ */
+DeferredInsert& Collection::insert(const std::vector<Variant::Value>& documents)
+{
+    // move a copy to the implementation
+    return insert(std::vector<Variant::Value>(documents));
+}
+
+/**
+ *  Update an existing document in the collection
+ *
+ *  @param  query       the query to find the document(s) to update
+ *  @param  document    the new document to replace existing document with
+ *  @param  upsert      if no matching document was found, create one instead
+ *  @param  multi       if multiple matching documents are found, update them all
+ */
+DeferredUpdate& Collection::update(Variant::Value&& query, Variant::Value&& document, bool upsert, bool multi)
+{
+    // pass to the connection
+    return _connection->update(_name, std::move(query), std::move(document), upsert, multi, _concern);
+}
+
+/**
+ *  Update an existing document in the collection
+ *
+ *  @param  query       the query to find the document(s) to update
+ *  @param  document    the new document to replace existing document with
+ *  @param  upsert      if no matching document was found, create one instead
+ *  @param  multi       if multiple matching documents are found, update them all
+ */
+DeferredUpdate& Collection::update(const Variant::Value& query, const Variant::Value& document, bool upsert, bool multi)
+{
+    // move copies to the implementation
+    return update(Variant::Value(query), Variant::Value(document), upsert, multi);
+}
+
+/**
+ *  Remove one or more existing documents from the collection
+ *
+ *  @param  query       the query to find the document(s) to remove
+ *  @param  limitToOne  limit the removal to a single document
+ */
+DeferredRemove& Collection::remove(Variant::Value&& query, bool limitToOne)
+{
+    // pass to the connection
+    return _connection->remove(_name, std::move(query), limitToOne, _concern);
+}
+
+/**
+ *  Remove one or more existing documents from the collection
+ *
+ *  @param  query       the query to find the document(s) to remove
+ *  @param  limitToOne  limit the removal to a single document
+ */
+DeferredRemove& Collection::remove(const Variant::Value& query, bool limitToOne)
+{
+    // move a copy to the implementation
+    return remove(Variant::Value(query), limitToOne);
+}
+
+/**
+ *  End namespace
+ */
+}}
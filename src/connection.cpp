@@ -26,16 +26,23 @@ namespace React { namespace Mongo {
  */
 Connection::Connection(React::Loop *loop, const std::string& host) :
     _loop(loop),
-    _worker(),
-    _master(loop)
+    _master(loop),
+    _host(host),
+    _throttle(loop),
+    _profiler(loop),
+    _lifetime(std::make_shared<Lifetime>()),
+    _validate(false),
+    _readAhead(0),
+    _worker()
 {
     // connect to mongo
     _worker.execute([this, host]() {
         // try to establish a connection to mongo
         try
         {
-            // connect throws an exception on failure
-            _mongo.connect(host);
+            // connect throws an exception on failure, when the first
+            // address fails all addresses of the host are tried at once
+            Resolver::connect(_mongo, host);
 
             // do we have anyone watching the connect callback
             if (_connectCallback) _master.execute([this]() { _connectCallback(nullptr); });
@@ -48,6 +55,23 @@ Connection::Connection(React::Loop *loop, const std::string& host) :
     });
 }
 
+/**
+ *  Destructor
+ */
+Connection::~Connection()
+{
+    // stop the timer, it no longer flushes
+    {
+        std::lock_guard<std::mutex> lock(_lifetime->mutex);
+        _lifetime->destroyed = true;
+    }
+    _lifetime->condition.notify_one();
+
+    // send the collected updates, the worker is stopped after the
+    // operations in its queue are done, which includes these updates
+    flush();
+}
+
 /**
  *  Convert a Variant object to a bson object
  *  used by the underlying mongo driver
@@ -116,140 +140,1071 @@ mongo::BSONObj Connection::convert(const Variant::Value& value)
         return builder.obj();
     }
 
-    // the value should be a vector or a map, this is invalid
-    return mongo::BSONObj();
-}
+    // the value should be a vector or a map, this is invalid
+    return mongo::BSONObj();
+}
+
+/**
+ *  Convert a mongo bson object used in the
+ *  underlying library to a Variant object
+ *
+ *  @param  value   the value to convert
+ */
+Variant::Value Connection::convert(const mongo::BSONObj& value)
+{
+    // is this an array object?
+    return value.couldBeArray() ? convertArray(value) : convertObject(value);
+}
+
+/**
+ *  Convert a single bson element
+ *
+ *  @param  element the element to convert
+ */
+Variant::Value Connection::convert(const mongo::BSONElement& element)
+{
+    // check the element type
+    switch (element.type())
+    {
+        case mongo::NumberDouble:   return Variant::Value(element.numberDouble());
+        case mongo::String:         return Variant::Value(element.str());
+        case mongo::Object:         return convert(element.Obj());
+        case mongo::Array:          return convertArray(element.Obj());
+        case mongo::Bool:           return Variant::Value(element.boolean());
+        case mongo::jstNULL:        return Variant::Value(nullptr);
+        case mongo::NumberInt:      return Variant::Value(element.numberInt());
+        default:
+            // unsupported type
+            return Variant::Value{};
+    }
+}
+
+/**
+ *  Convert a bson array
+ *
+ *  @param  value   the value to convert
+ */
+Variant::Value Connection::convertArray(const mongo::BSONObj& value)
+{
+    // the vector to construct the result from, we know how large it gets
+    std::vector<Variant::Value> result;
+    result.reserve(value.nFields());
+
+    // "iterate" over all the values
+    for (auto iter = value.begin(); iter.more(); ) result.emplace_back(convert(iter.next()));
+
+    // return the result
+    return result;
+}
+
+/**
+ *  Convert a bson object
+ *
+ *  @param  value   the value to convert
+ */
+Variant::Value Connection::convertObject(const mongo::BSONObj& value)
+{
+    // the map to construct the result from
+    std::map<std::string, Variant::Value> result;
+
+    // "iterate" over all the values
+    for (auto iter = value.begin(); iter.more(); )
+    {
+        // retrieve the element
+        auto element = iter.next();
+
+        // documents written by this library have their fields in the order
+        // of the map, so we can usually add at the end without searching
+        auto entry = result.emplace_hint(result.end(), std::piecewise_construct, std::forward_as_tuple(element.fieldName()), std::forward_as_tuple());
+
+        // add element to the result, a repeated field overwrites the earlier one
+        entry->second = convert(element);
+    }
+
+    // return the result
+    return result;
+}
+
+/**
+ *  Check a document when validation is enabled
+ *
+ *  @param  document    the encoded document
+ *  @return the same document
+ *  @throws mongo::UserException    if the document is invalid
+ */
+mongo::BSONObj Connection::check(const mongo::BSONObj& document)
+{
+    // is validation enabled, and is the document valid?
+    if (!_validate || Validator::validate(document)) return document;
+
+    // this is treated like any other failure of the operation
+    throw mongo::UserException(0, "Invalid bson document");
+}
+
+/**
+ *  Run a query and report the results to the deferred.
+ *
+ *  This method must be called from the worker thread.
+ *
+ *  @param  collection  database name and collection
+ *  @param  query       the encoded query to execute
+ *  @param  options     query options
+ *  @param  deferred    the deferred to report to
+ *  @param  submitted   when the query was started on the event loop
+ *  @param  snapshot    the write behind snapshot taken when the query was started
+ */
+void Connection::fetch(const std::shared_ptr<const std::string>& collection, const mongo::Query& query, int options, const std::shared_ptr<DeferredQuery>& deferred, Profiler::Clock::time_point submitted, size_t snapshot)
+{
+    try
+    {
+        // the state to check whether the connection still exists
+        auto lifetime = _lifetime;
+
+        // run the query and convert the results
+        auto result = collect<Variant::Value>(*collection, query, options, submitted, [this](const mongo::BSONObj& document) { return convert(check(document)); });
+
+        // we now have all results, execute callback in master thread
+        _master.execute([this, collection, snapshot, result, deferred, lifetime]() {
+            // apply the updates the server did not have yet
+            if (!lifetime->destroyed) _writeBehind.apply(*collection, snapshot, *result);
+
+            // report the result
+            deferred->success(std::move(*result));
+        });
+    }
+    catch (mongo::DBException& exception)
+    {
+        // something went awry, notify listener
+        _master.execute([deferred, exception]() { deferred->failure(exception.toString().c_str()); });
+    }
+}
+
+/**
+ *  Report a query that took longer than the threshold
+ *
+ *  This method must be called from the worker thread.
+ *
+ *  @param  collection  database name and collection
+ *  @param  query       the query that was executed
+ *  @param  measurement the timings of the query
+ */
+void Connection::report(const std::string& collection, const mongo::Query& query, const Profiler::Measurement& measurement)
+{
+    // the filter, without the sort order and other modifiers
+    auto filter = query.isComplex() ? query.getFilter() : query.obj;
+
+    // describe the operation
+    auto operation = std::make_shared<SlowOperation>();
+    operation->collection = collection;
+    operation->shape = Profiler::shape(filter);
+    operation->queued = measurement.queued;
+    operation->server = measurement.server;
+    operation->fetch = measurement.fetch;
+    operation->convert = measurement.convert;
+    operation->total = measurement.total();
+    operation->documents = measurement.documents;
+    operation->bytes = measurement.bytes;
+
+    // add it to the statistics of the shape, and explain it if this was not done before
+    if (_profiler.record(*operation))
+    {
+        // the database and the collection are separated by the first dot
+        auto dot = collection.find('.');
+
+        // the command to explain the query
+        mongo::BSONObjBuilder find;
+        find.append("find", collection.substr(dot + 1));
+        find.append("filter", filter);
+        if (query.isComplex() && !query.getSort().isEmpty()) find.append("sort", query.getSort());
+
+        // we only need the plan, not the execution statistics
+        auto command = BSON("explain" << find.obj() << "verbosity" << "queryPlanner");
+
+        // run the command, a failure leaves the plan empty
+        mongo::BSONObj result;
+        try { if (_mongo.runCommand(collection.substr(0, dot), command, result)) operation->explain = convert(result); }
+        catch (const mongo::DBException&) {}
+
+        // the shape is not explained again
+        _profiler.explained(operation->shape, operation->explain);
+    }
+
+    // pass it to the callback
+    _profiler.report(std::move(operation));
+}
+
+/**
+ *  Report the result of a write operation to the deferred.
+ *
+ *  This method must be called from the worker thread.
+ *
+ *  @param  deferred    the deferred to report to
+ *  @param  concern     the write concern to wait for
+ */
+void Connection::acknowledge(const std::shared_ptr<Deferred<>>& deferred, const WriteConcern& concern)
+{
+    // is anybody interested in the result?
+    if (!deferred->requireStatus())
+    {
+        // inform the listener we are done
+        _master.execute([deferred]() { deferred->complete(); });
+        return;
+    }
+
+    // the error that could have occured
+    auto error = _mongo.getLastError(false, concern.journal, concern.w, concern.timeout);
+
+    // check whether an error occured
+    if (error.empty()) _master.execute([deferred]() { deferred->success(); });
+    else _master.execute([deferred, error]() { deferred->failure(error.c_str()); });
+}
+
+/**
+ *  Run a job in the worker, and remove it from the
+ *  pending operations when it is finished
+ *
+ *  @param  documents   number of documents in the operation
+ *  @param  job         the job to run
+ */
+void Connection::execute(size_t documents, std::function<void()>&& job)
+{
+    // run the job in the worker
+    _worker.execute([this, documents, job]() {
+        // run the job, the operation is no longer pending
+        // afterwards, also when the job throws
+        try { job(); }
+        catch (...) { _throttle.release(documents); throw; }
+
+        // the operation is no longer pending
+        _throttle.release(documents);
+    });
+}
+
+/**
+ *  Limit the number of pending operations
+ *
+ *  @param  operations  maximum number of pending operations, zero for no limit
+ *  @param  documents   maximum number of pending documents, zero for no limit
+ *  @param  policy      what to do when the limits are reached
+ */
+void Connection::setLimits(size_t operations, size_t documents, Overload policy)
+{
+    // pass on to the throttle
+    _throttle.set(operations, documents, policy);
+}
+
+/**
+ *  Get a call when the limits are exceeded, with the notify policy
+ *
+ *  @param  callback    the callback to execute
+ */
+void Connection::onOverload(const std::function<void()>& callback)
+{
+    // register the callback
+    _throttle.onOverload(callback);
+}
+
+/**
+ *  Get a call when the pending operations dropped below half the
+ *  limits again, after the overload callback was called
+ *
+ *  @param  callback    the callback to execute
+ */
+void Connection::onDrained(const std::function<void()>& callback)
+{
+    // register the callback
+    _throttle.onDrained(callback);
+}
+
+/**
+ *  Get a call for every query that takes longer than a threshold
+ *
+ *  @param  threshold   threshold in milliseconds
+ *  @param  callback    the callback, or an empty function to stop measuring
+ *  @param  explain     should the plan of slow shapes be requested?
+ */
+void Connection::onSlowOperation(double threshold, const std::function<void(const SlowOperation&)>& callback, bool explain)
+{
+    // pass on to the profiler
+    _profiler.set(threshold, callback, explain);
+}
+
+/**
+ *  Collect updates of hot documents and send them periodically
+ *
+ *  @param  interval    interval in seconds, zero sends the updates right away again
+ */
+void Connection::setWriteBehind(double interval)
+{
+    // start the timer the first time
+    if (interval > 0.0 && !_timer) _timer.reset(new React::Worker());
+
+    // store the interval
+    _writeBehind.setInterval(interval);
+
+    // when disabled, the collected updates are sent right away
+    if (interval <= 0.0) flush();
+}
+
+/**
+ *  Send the collected updates right away
+ */
+void Connection::flush()
+{
+    // take the collected updates out of the buffer
+    auto batch = _writeBehind.take();
+
+    // is there anything to send?
+    if (!batch) return;
+
+    // the state to check whether the connection still exists
+    auto lifetime = _lifetime;
+
+    // send the updates in the worker, after the operations before them
+    _worker.execute([this, batch, lifetime]() {
+        // send all updates
+        for (auto &iter : *batch)
+        {
+            // the updates of the document
+            auto &entry = iter.second;
+
+            // do the deferreds need the result?
+            bool status = false;
+            for (auto &deferred : entry.deferreds) status = status || deferred->requireStatus();
+
+            try
+            {
+                // execute the merged update
+                _mongo.update(entry.collection, convert(entry.query()), check(convert(entry.update())), entry.upsert);
+
+                // the error that could have occured
+                auto error = status ? _mongo.getLastError() : std::string();
+
+                // inform the listeners
+                _master.execute([batch, &entry, error]() {
+                    // report to every update that was merged
+                    for (auto &deferred : entry.deferreds)
+                    {
+                        // check whether an error occured
+                        if (error.empty()) deferred->success();
+                        else deferred->failure(error.c_str());
+                    }
+                });
+            }
+            catch (const mongo::DBException& exception)
+            {
+                // inform the listeners of the failure
+                _master.execute([batch, &entry, exception]() {
+                    // report to every update that was merged
+                    for (auto &deferred : entry.deferreds) deferred->failure(exception.toString().c_str());
+                });
+            }
+        }
+
+        // the server has all updates, queries no longer need to apply them
+        _master.execute([this, lifetime]() { if (!lifetime->destroyed) _writeBehind.finished(); });
+    });
+}
+
+/**
+ *  Enable or disable validation of documents
+ *
+ *  @param  validate    should documents be validated
+ */
+void Connection::setValidation(bool validate)
+{
+    // store the setting, it is used by the worker
+    _validate = validate;
+}
+
+/**
+ *  Convert query results while the next batch is fetched
+ *
+ *  @param  batches     maximum number of batches waiting, zero to disable
+ */
+void Connection::setReadAhead(size_t batches)
+{
+    // start the converter the first time, this happens before the depth
+    // is stored, so the worker never sees a depth without a converter
+    if (batches > 0 && !_converter) _converter.reset(new React::Worker());
+
+    // store the depth
+    _readAhead = batches;
+}
+
+/**
+ *  Get a call when the connection succeeds or fails
+ *
+ *  @param  callback    the callback that will be informed of the connection status
+ */
+void Connection::onConnected(const std::function<void(const char *error)>& callback)
+{
+    // register the callback
+    _connectCallback = callback;
+}
+
+/**
+ *  Query a collection
+ *
+ *  @param  collection  database name and collection
+ *  @param  query       the query to execute
+ *
+ *  The returned deferred object has an onSuccess method that
+ *  will give the result as an rvalue-reference. It can thus
+ *  be used something like this:
+ *
+ *  connection.query("collection", Variant::Value()).onSuccess([](Variant::Value&& result) {
+ *      // do something with result here
+ *  });
+ */
+DeferredQuery& Connection::query(const std::string& collection, Variant::Value&& query)
+{
+    // pass the namespace to the implementation
+    return this->query(std::make_shared<const std::string>(collection), std::move(query), 0);
+}
+
+/**
+ *  Query a collection
+ *
+ *  @param  collection  database name and collection
+ *  @param  query       the query to execute
+ *  @param  options     query options
+ */
+DeferredQuery& Connection::query(const std::shared_ptr<const std::string>& collection, Variant::Value&& query, int options)
+{
+    // move the query to a pointer to avoid needless copying
+    auto request = std::make_shared<Variant::Value>(std::move(query));
+
+    // create the deferred handler
+    auto deferred = std::make_shared<DeferredQuery>();
+
+    // check whether we are within the limits
+    if (!_throttle.acquire(1)) return reject(deferred);
+
+    // when the query was started
+    auto submitted = Profiler::Clock::now();
+
+    // the updates the server already has
+    auto snapshot = _writeBehind.snapshot();
+
+    // run the query in the worker
+    execute(1, [this, collection, request, options, deferred, submitted, snapshot]() { fetch(collection, convert(*request), options, deferred, submitted, snapshot); });
+
+    // return the deferred handler
+    return *deferred;
+}
+
+/**
+ *  Query a collection
+ *
+ *  Note:   This function will make a copy of the query object. This
+ *          can be useful when you want to reuse the given query object,
+ *          otherwise it is best to pass in an rvalue and avoid the copy.
+ *
+ *  @param  collection  database name and collection
+ *  @param  query       the query to execute
+ *
+ *  The returned deferred object has an onSuccess method that
+ *  will give the result as an rvalue-reference. It can thus
+ *  be used something like this:
+ *
+ *  connection.query("collection", Variant::Value()).onSuccess([](Variant::Value&& result) {
+ *      // do something with result here
+ *  });
+ */
+DeferredQuery& Connection::query(const std::string& collection, const Variant::Value& query)
+{
+    // throw a copy to the implementation
+    return this->query(collection, Variant::Value(query));
+}
+
+/**
+ *  Prepare a query for repeated execution
+ *
+ *  @param  query       the query template
+ *  @param  parameters  paths of the values to replace on execution
+ *  @throws std::invalid_argument   if a parameter cannot be found, is not supported, or overlaps another
+ */
+PreparedQuery Connection::prepare(const Variant::Value& query, const std::vector<std::string>& parameters)
+{
+    // convert the template once and find the parameters in it
+    return PreparedQuery(convert(query), parameters);
+}
+
+/**
+ *  Query a collection using a prepared query
+ *
+ *  @param  collection  database name and collection
+ *  @param  query       the prepared query to execute
+ *  @param  parameters  the values for the parameters in the query
+ */
+DeferredQuery& Connection::query(const std::string& collection, const PreparedQuery& query, std::vector<Variant::Value>&& parameters)
+{
+    // pass the namespace to the implementation
+    return this->query(std::make_shared<const std::string>(collection), query, std::move(parameters), 0);
+}
+
+/**
+ *  Query a collection using a prepared query
+ *
+ *  @param  collection  database name and collection
+ *  @param  query       the prepared query to execute
+ *  @param  parameters  the values for the parameters in the query
+ *  @param  options     query options
+ */
+DeferredQuery& Connection::query(const std::shared_ptr<const std::string>& collection, const PreparedQuery& query, std::vector<Variant::Value>&& parameters, int options)
+{
+    // move the parameters to a pointer to avoid needless copying
+    auto values = std::make_shared<std::vector<Variant::Value>>(std::move(parameters));
+
+    // create the deferred handler
+    auto deferred = std::make_shared<DeferredQuery>();
+
+    // check whether we are within the limits
+    if (!_throttle.acquire(1)) return reject(deferred);
+
+    // when the query was started, and the updates the server already has
+    auto submitted = Profiler::Clock::now();
+    auto snapshot = _writeBehind.snapshot();
+
+    // run the query in the worker
+    execute(1, [this, collection, query, values, options, deferred, submitted, snapshot]() {
+        // the buffer to fill with the encoded query, every worker
+        // job runs on the same thread, so it can be reused
+        static thread_local std::string buffer;
+
+        // fill in the parameters
+        if (!query.bind(*values, buffer))
+        {
+            // the caller gave us the wrong number of values
+            _master.execute([deferred]() { deferred->failure("Invalid number of query parameters"); });
+            return;
+        }
+
+        // the buffer holds the complete query
+        fetch(collection, mongo::BSONObj(buffer.data()), options, deferred, submitted, snapshot);
+    });
+
+    // return the deferred handler
+    return *deferred;
+}
+
+/**
+ *  Query a collection using a prepared query
+ *
+ *  Note:   This function will make a copy of the parameters. This
+ *          can be useful when you want to reuse the given parameters,
+ *          otherwise it is best to pass in an rvalue and avoid the copy.
+ *
+ *  @param  collection  database name and collection
+ *  @param  query       the prepared query to execute
+ *  @param  parameters  the values for the parameters in the query
+ */
+DeferredQuery& Connection::query(const std::string& collection, const PreparedQuery& query, const std::vector<Variant::Value>& parameters)
+{
+    // move a copy to the implementation
+    return this->query(collection, query, std::vector<Variant::Value>(parameters));
+}
+
+/**
+ *  Write a buffer to a file
+ *
+ *  @param  fd          the file to write to
+ *  @param  buffer      the data to write
+ *  @throws mongo::UserException    if writing failed
+ */
+static void store(int fd, const std::string& buffer)
+{
+    // write until everything is written
+    for (size_t written = 0; written < buffer.size(); )
+    {
+        // write as much as possible
+        auto result = ::write(fd, buffer.data() + written, buffer.size() - written);
+
+        // an interrupted write is simply repeated
+        if (result < 0 && errno == EINTR) continue;
+
+        // other errors are fatal
+        if (result < 0) throw mongo::UserException(errno, strerror(errno));
+
+        // move past the written data
+        written += result;
+    }
+}
+
+/**
+ *  Query a collection, storing the results in a temporary file
+ *
+ *  @param  collection  database name and collection
+ *  @param  query       the query to execute
+ *  @param  directory   directory to create the temporary file in
+ */
+DeferredSpill& Connection::spill(const std::string& collection, Variant::Value&& query, const std::string& directory)
+{
+    // move the query to a pointer to avoid needless copying
+    auto request = std::make_shared<Variant::Value>(std::move(query));
+
+    // create the deferred handler
+    auto deferred = std::make_shared<DeferredSpill>();
+
+    // the collected updates of the collection must be applied first
+    if (_writeBehind.pending(collection)) flush();
+
+    // check whether we are within the limits
+    if (!_throttle.acquire(1)) return reject(deferred);
+
+    // run the query in the worker
+    execute(1, [this, collection, request, directory, deferred]() {
+        // the temporary file
+        int fd = -1;
+
+        try
+        {
+            // create the file
+            std::string path = directory + "/reactcpp-mongo-XXXXXX";
+            fd = mkstemp(&path[0]);
+            if (fd < 0) throw mongo::UserException(errno, strerror(errno));
+
+            // remove it right away, it is gone as soon as it is no longer used
+            unlink(path.c_str());
+
+            // execute query
+            auto cursor = _mongo.query(collection, convert(*request));
+
+            // connection failures are reported by returning nothing
+            if (cursor.get() == NULL) throw mongo::UserException(0, "Unspecified connection error");
+
+            // offset of every document, and the size of the data written so far
+            std::vector<size_t> offsets;
+            size_t size = 0;
+
+            // documents are collected in a buffer, so that we
+            // write to the file in large blocks
+            std::string buffer;
+            buffer.reserve(1024 * 1024);
+
+            // process all results
+            while (cursor->more())
+            {
+                // the next document, unchanged
+                auto document = check(cursor->next());
+
+                // add it to the buffer
+                offsets.push_back(size + buffer.size());
+                buffer.append(document.objdata(), document.objsize());
+
+                // is the buffer full?
+                if (buffer.size() < 1024 * 1024) continue;
+
+                // write it to the file
+                store(fd, buffer);
+                size += buffer.size();
+                buffer.clear();
+            }
+
+            // write the rest
+            store(fd, buffer);
+            size += buffer.size();
+
+            // map the file, the mapping remains valid after the file is closed
+            auto result = std::make_shared<Documents>(fd, size, std::move(offsets));
+            close(fd);
+
+            // we now have all results, execute callback in master thread
+            _master.execute([result, deferred]() { deferred->success(std::move(*result)); });
+        }
+        catch (mongo::DBException& exception)
+        {
+            // the file is no longer needed
+            if (fd >= 0) close(fd);
+
+            // something went awry, notify listener
+            _master.execute([deferred, exception]() { deferred->failure(exception.toString().c_str()); });
+        }
+    });
+
+    // return the deferred handler
+    return *deferred;
+}
+
+/**
+ *  Query a collection, storing the results in a temporary file
+ *
+ *  Note:   This function will make a copy of the query object. This
+ *          can be useful when you want to reuse the given query object,
+ *          otherwise it is best to pass in an rvalue and avoid the copy.
+ *
+ *  @param  collection  database name and collection
+ *  @param  query       the query to execute
+ *  @param  directory   directory to create the temporary file in
+ */
+DeferredSpill& Connection::spill(const std::string& collection, const Variant::Value& query, const std::string& directory)
+{
+    // move a copy to the implementation
+    return spill(collection, Variant::Value(query), directory);
+}
+
+/**
+ *  Count the documents matching a query
+ *
+ *  @param  collection  database name and collection
+ *  @param  query       the query to match
+ */
+DeferredCount& Connection::count(const std::string& collection, Variant::Value&& query)
+{
+    // move the query to a pointer to avoid needless copying
+    auto request = std::make_shared<Variant::Value>(std::move(query));
+
+    // create the deferred handler
+    auto deferred = std::make_shared<DeferredCount>();
+
+    // the collected updates of the collection must be applied first
+    if (_writeBehind.pending(collection)) flush();
+
+    // check whether we are within the limits
+    if (!_throttle.acquire(1)) return reject(deferred);
+
+    // count in the worker
+    execute(1, [this, collection, request, deferred]() {
+        try
+        {
+            // let the server count the documents
+            size_t count = _mongo.count(collection, convert(*request));
+
+            // report the result
+            _master.execute([deferred, count]() { deferred->success(count); });
+        }
+        catch (const mongo::DBException& exception)
+        {
+            // inform the listener of the failure
+            _master.execute([deferred, exception]() { deferred->failure(exception.toString().c_str()); });
+        }
+    });
+
+    // return the deferred handler
+    return *deferred;
+}
+
+/**
+ *  Count the documents matching a query
+ *
+ *  @param  collection  database name and collection
+ *  @param  query       the query to match
+ */
+DeferredCount& Connection::count(const std::string& collection, const Variant::Value& query)
+{
+    // move a copy to the implementation
+    return count(collection, Variant::Value(query));
+}
+
+/**
+ *  Check whether any document matches a query
+ *
+ *  @param  collection  database name and collection
+ *  @param  query       the query to match
+ */
+DeferredExists& Connection::exists(const std::string& collection, Variant::Value&& query)
+{
+    // move the query to a pointer to avoid needless copying
+    auto request = std::make_shared<Variant::Value>(std::move(query));
+
+    // create the deferred handler
+    auto deferred = std::make_shared<DeferredExists>();
+
+    // the collected updates of the collection must be applied first
+    if (_writeBehind.pending(collection)) flush();
+
+    // check whether we are within the limits
+    if (!_throttle.acquire(1)) return reject(deferred);
+
+    // check in the worker
+    execute(1, [this, collection, request, deferred]() {
+        try
+        {
+            // we only need the _id, of a single document
+            auto fields = BSON("_id" << 1);
+
+            // an empty document is returned if nothing matches
+            bool exists = !_mongo.findOne(collection, convert(*request), &fields).isEmpty();
+
+            // report the result
+            _master.execute([deferred, exists]() { deferred->success(exists); });
+        }
+        catch (const mongo::DBException& exception)
+        {
+            // inform the listener of the failure
+            _master.execute([deferred, exception]() { deferred->failure(exception.toString().c_str()); });
+        }
+    });
+
+    // return the deferred handler
+    return *deferred;
+}
+
+/**
+ *  Check whether any document matches a query
+ *
+ *  @param  collection  database name and collection
+ *  @param  query       the query to match
+ */
+DeferredExists& Connection::exists(const std::string& collection, const Variant::Value& query)
+{
+    // move a copy to the implementation
+    return exists(collection, Variant::Value(query));
+}
+
+/**
+ *  Get the distinct values of a field in the documents matching a query
+ *
+ *  @param  collection  database name and collection
+ *  @param  field       the field to get the values of, may use dots
+ *  @param  query       the query to match, null for all documents
+ */
+DeferredDistinct& Connection::distinct(const std::string& collection, const std::string& field, Variant::Value&& query)
+{
+    // move the query to a pointer to avoid needless copying
+    auto request = std::make_shared<Variant::Value>(std::move(query));
+
+    // create the deferred handler
+    auto deferred = std::make_shared<DeferredDistinct>();
+
+    // the collected updates of the collection must be applied first
+    if (_writeBehind.pending(collection)) flush();
+
+    // check whether we are within the limits
+    if (!_throttle.acquire(1)) return reject(deferred);
+
+    // run the command in the worker
+    execute(1, [this, collection, field, request, deferred]() {
+        try
+        {
+            // the server sends the values as an array
+            auto values = _mongo.distinct(collection, field, convert(*request));
+
+            // convert only the values, an empty array stays an array
+            auto result = std::make_shared<Variant::Value>(convertArray(values));
+
+            // report the result
+            _master.execute([deferred, result]() { deferred->success(std::move(*result)); });
+        }
+        catch (const mongo::DBException& exception)
+        {
+            // inform the listener of the failure
+            _master.execute([deferred, exception]() { deferred->failure(exception.toString().c_str()); });
+        }
+    });
+
+    // return the deferred handler
+    return *deferred;
+}
+
+/**
+ *  Get the distinct values of a field in the documents matching a query
+ *
+ *  @param  collection  database name and collection
+ *  @param  field       the field to get the values of, may use dots
+ *  @param  query       the query to match
+ */
+DeferredDistinct& Connection::distinct(const std::string& collection, const std::string& field, const Variant::Value& query)
+{
+    // move a copy to the implementation
+    return distinct(collection, field, Variant::Value(query));
+}
+
+/**
+ *  Get many documents by their _id
+ *
+ *  @param  collection  database name and collection
+ *  @param  ids         the ids of the documents
+ *  @param  ordered     should the documents be returned in the order of the ids?
+ *  @param  chunk       maximum number of ids per query
+ */
+DeferredQuery& Connection::getMany(const std::string& collection, std::vector<Variant::Value>&& ids, bool ordered, size_t chunk)
+{
+    // move the ids to a pointer to avoid needless copying
+    auto keys = std::make_shared<std::vector<Variant::Value>>(std::move(ids));
+
+    // create the deferred handler
+    auto deferred = std::make_shared<DeferredQuery>();
+
+    // the collected updates of the collection must be applied first
+    if (_writeBehind.pending(collection)) flush();
+
+    // check whether we are within the limits
+    if (!_throttle.acquire(1)) return reject(deferred);
+
+    // a chunk holds at least one id
+    chunk = std::max(chunk, (size_t)1);
+
+    // run the queries in the worker
+    execute(1, [this, collection, keys, ordered, chunk, deferred]() {
+        /**
+         *  Compare the values of ids, regardless of their field names
+         */
+        struct Compare
+        {
+            bool operator()(const mongo::BSONElement& a, const mongo::BSONElement& b) const
+            {
+                return a.woCompare(b, false) < 0;
+            }
+
+            bool operator()(const mongo::BSONObj& a, const mongo::BSONObj& b) const
+            {
+                return a.firstElement().woCompare(b.firstElement(), false) < 0;
+            }
+        };
+
+        try
+        {
+            // the documents in the order of the ids, or in the order they were found
+            std::vector<Variant::Value> documents(ordered ? keys->size() : 0);
+
+            // the ids of the documents that were found, so that a document
+            // whose id was asked for in several chunks is only added once
+            std::set<mongo::BSONObj, Compare> found;
+
+            // process the ids in chunks
+            for (size_t start = 0; start < keys->size(); start += chunk)
+            {
+                // the ids in this chunk
+                size_t end = std::min(start + chunk, keys->size());
+
+                // encode the ids, the converted vector is an object with
+                // the indexes as field names, so it is added as an array
+                auto ids = convert(Variant::Value(std::vector<Variant::Value>(keys->begin() + start, keys->begin() + end)));
+
+                // find the position of every id, the same id may be asked for more than once
+                std::multimap<mongo::BSONElement, size_t, Compare> positions;
+                size_t position = start;
+                for (mongo::BSONObjIterator iter(ids); iter.more(); ) positions.emplace(iter.next(), position++);
+
+                // the query selecting the documents
+                mongo::BSONObjBuilder in;
+                in.appendArray("$in", ids);
+                auto query = BSON("_id" << in.obj());
+
+                // execute the query, no more documents can match than there are ids
+                auto cursor = _mongo.query(collection, query, end - start);
+
+                // check for connection failures
+                if (cursor.get() == NULL) throw mongo::UserException(0, "Unspecified connection error");
 
-/**
- *  Convert a mongo bson object used in the
- *  underlying library to a Variant object
- *
- *  @param  value   the value to convert
- */
-Variant::Value Connection::convert(const mongo::BSONObj& value)
-{
-    // retrieve element value
-    auto convertElement = [this](const mongo::BSONElement& element) -> Variant::Value {
-        // check the element type
-        switch (element.type())
-        {
-            case mongo::NumberDouble:   return Variant::Value(element.numberDouble());
-            case mongo::String:         return Variant::Value(element.str());
-            case mongo::Object:         return convert(element.Obj());
-            case mongo::Array:          return convert(element.Obj());
-            case mongo::Bool:           return Variant::Value(element.boolean());
-            case mongo::jstNULL:        return Variant::Value(nullptr);
-            case mongo::NumberInt:      return Variant::Value(element.numberInt());
-            default:
-                // unsupported type
-                return Variant::Value{};
-        }
-    };
+                // process all documents
+                while (cursor->more())
+                {
+                    // the next document and its id
+                    auto document = cursor->next();
+                    auto id = document.getField("_id");
 
-    // is this an array object?
-    if (value.couldBeArray())
-    {
-        // the vector to construct the result from
-        std::vector<Variant::Value> result;
+                    // find the ids that asked for it
+                    auto range = positions.equal_range(id);
+                    if (range.first == range.second) continue;
 
-        // "iterate" over all the values
-        for (auto iter = value.begin(); iter.more(); )
-        {
-            // retrieve the element
-            auto element = iter.next();
+                    // convert the document
+                    auto value = convert(check(document));
 
-            // add element to the result
-            result.push_back(convertElement(element));
-        }
+                    // add it, unless an earlier chunk already found it
+                    if (!ordered) { if (found.insert(id.wrap()).second) documents.push_back(std::move(value)); }
 
-        // return the result
-        return result;
-    }
-    else
-    {
-        // the map to construct the result from
-        std::map<std::string, Variant::Value> result;
+                    // or at every position it was asked for
+                    else for (auto iter = range.first; iter != range.second; ++iter) documents[iter->second] = value;
+                }
+            }
 
-        // "iterate" over all the values
-        for (auto iter = value.begin(); iter.more(); )
-        {
-            // retrieve the element
-            auto element = iter.next();
+            // the result to report
+            auto result = std::make_shared<Variant::Value>(std::move(documents));
 
-            // add element to the result
-            result[element.fieldName()] = convertElement(element);
+            // report the result
+            _master.execute([result, deferred]() { deferred->success(std::move(*result)); });
+        }
+        catch (const mongo::DBException& exception)
+        {
+            // inform the listener of the failure
+            _master.execute([deferred, exception]() { deferred->failure(exception.toString().c_str()); });
         }
+    });
 
-        // return the result
-        return result;
-    }
+    // return the deferred handler
+    return *deferred;
 }
 
 /**
- *  Get a call when the connection succeeds or fails
+ *  Get many documents by their _id
  *
- *  @param  callback    the callback that will be informed of the connection status
+ *  @param  collection  database name and collection
+ *  @param  ids         the ids of the documents
+ *  @param  ordered     should the documents be returned in the order of the ids?
+ *  @param  chunk       maximum number of ids per query
  */
-void Connection::onConnected(const std::function<void(const char *error)>& callback)
+DeferredQuery& Connection::getMany(const std::string& collection, const std::vector<Variant::Value>& ids, bool ordered, size_t chunk)
 {
-    // register the callback
-    _connectCallback = callback;
+    // move a copy to the implementation
+    return getMany(collection, std::vector<Variant::Value>(ids), ordered, chunk);
 }
 
 /**
- *  Query a collection
+ *  Atomically find a document and modify it
  *
  *  @param  collection  database name and collection
- *  @param  query       the query to execute
- *
- *  The returned deferred object has an onSuccess method that
- *  will give the result as an rvalue-reference. It can thus
- *  be used something like this:
- *
- *  connection.query("collection", Variant::Value()).onSuccess([](Variant::Value&& result) {
- *      // do something with result here
- *  });
+ *  @param  query       the query to find the document
+ *  @param  document    the update, or the document to replace it with
+ *  @param  options     sort order, fields to return, upsert and return new
  */
-DeferredQuery& Connection::query(const std::string& collection, Variant::Value&& query)
+DeferredModify& Connection::findAndModify(const std::string& collection, Variant::Value&& query, Variant::Value&& document, const ModifyOptions& options)
 {
-    // move the query to a pointer to avoid needless copying
+    // move the query and document to a pointer to avoid needless copying
     auto request = std::make_shared<Variant::Value>(std::move(query));
+    auto update  = std::make_shared<Variant::Value>(std::move(document));
 
     // create the deferred handler
-    auto deferred = std::make_shared<DeferredQuery>();
+    auto deferred = std::make_shared<DeferredModify>();
 
-    // run the query in the worker
-    _worker.execute([this, collection, request, deferred]() {
+    // the collected updates of the collection must be applied first
+    if (_writeBehind.pending(collection)) flush();
+
+    // check whether we are within the limits
+    if (!_throttle.acquire(1)) return reject(deferred);
+
+    // run the command in the worker
+    execute(1, [this, collection, request, update, options, deferred]() {
         try
         {
-            // execute query
-            auto cursor = _mongo.query(collection, convert(*request));
+            // the database and the collection are separated by the first dot
+            auto dot = collection.find('.');
+
+            // build the command
+            mongo::BSONObjBuilder command;
+            command.append("findAndModify", collection.substr(dot + 1));
+            command.append("query", convert(*request));
+            command.append("update", check(convert(*update)));
+            if (options.sort.type() == Variant::ValueMapType) command.append("sort", convert(options.sort));
+            if (options.fields.type() == Variant::ValueMapType) command.append("fields", convert(options.fields));
+            command.append("upsert", options.upsert);
+            command.append("new", options.returnNew);
+
+            // execute the command
+            mongo::BSONObj result;
+            _mongo.runCommand(collection.substr(0, dot), command.obj(), result);
 
-            /**
-             *  Even though mongo can throw exceptions for the query
-             *  function, it communicates connection failures not by
-             *  throwing an exception, but instead returning 0 when
-             *  a connection failure occurs, so we check for this.
-             */
-            if (cursor.get() == NULL)
+            // did the command fail?
+            if (!result.getField("ok").numberDouble())
             {
-                // notify listener that a connection failure occured
-                _master.execute([deferred]() { deferred->failure("Unspecified connection error"); });
+                // there should be an error string
+                auto error = result.getField("errmsg").str();
+                _master.execute([deferred, error]() { deferred->failure(error.c_str()); });
                 return;
             }
 
-            // build the result value
-            auto result = std::make_shared<std::vector<Variant::Value>>();
-
-            // process all results
-            while (cursor->more()) result->push_back(convert(cursor->next()));
+            // the document, which is null if no document matched
+            auto value = result.getField("value");
+            auto output = std::make_shared<Variant::Value>(value.type() == mongo::Object ? convert(check(value.embeddedObject())) : Variant::Value());
 
-            // we now have all results, execute callback in master thread
-            _master.execute([result, deferred]() { deferred->success(std::move(*result)); });
+            // report the document
+            _master.execute([deferred, output]() { deferred->success(std::move(*output)); });
         }
-        catch (mongo::DBException& exception)
+        catch (const mongo::DBException& exception)
         {
-            // something went awry, notify listener
+            // inform the listener of the failure
             _master.execute([deferred, exception]() { deferred->failure(exception.toString().c_str()); });
         }
     });
@@ -259,27 +1214,17 @@ DeferredQuery& Connection::query(const std::string& collection, Variant::Value&&
 }
 
 /**
- *  Query a collection
- *
- *  Note:   This function will make a copy of the query object. This
- *          can be useful when you want to reuse the given query object,
- *          otherwise it is best to pass in an rvalue and avoid the copy.
+ *  Atomically find a document and modify it
  *
  *  @param  collection  database name and collection
- *  @param  query       the query to execute
- *
- *  The returned deferred object has an onSuccess method that
- *  will give the result as an rvalue-reference. It can thus
- *  be used something like this:
- *
- *  connection.query("collection", Variant::Value()).onSuccess([](Variant::Value&& result) {
- *      // do something with result here
- *  });
+ *  @param  query       the query to find the document
+ *  @param  document    the update, or the document to replace it with
+ *  @param  options     sort order, fields to return, upsert and return new
  */
-DeferredQuery& Connection::query(const std::string& collection, const Variant::Value& query)
+DeferredModify& Connection::findAndModify(const std::string& collection, const Variant::Value& query, const Variant::Value& document, const ModifyOptions& options)
 {
-    // throw a copy to the implementation
-    return this->query(collection, Variant::Value(query));
+    // move copies to the implementation
+    return findAndModify(collection, Variant::Value(query), Variant::Value(document), options);
 }
 
 /**
@@ -289,6 +1234,19 @@ DeferredQuery& Connection::query(const std::string& collection, const Variant::V
  *  @param  document    document to insert
  */
 DeferredInsert& Connection::insert(const std::string& collection, Variant::Value&& document)
+{
+    // pass the namespace to the implementation
+    return insert(std::make_shared<const std::string>(collection), std::move(document), WriteConcern());
+}
+
+/**
+ *  Insert a document into a collection
+ *
+ *  @param  collection  database name and collection
+ *  @param  document    document to insert
+ *  @param  concern     the write concern to wait for
+ */
+DeferredInsert& Connection::insert(const std::shared_ptr<const std::string>& collection, Variant::Value&& document, const WriteConcern& concern)
 {
     // move the document to a pointer to avoid needless copying
     auto insert = std::make_shared<Variant::Value>(std::move(document));
@@ -296,27 +1254,18 @@ DeferredInsert& Connection::insert(const std::string& collection, Variant::Value
     // create the deferred handler
     auto deferred = std::make_shared<DeferredInsert>();
 
+    // check whether we are within the limits
+    if (!_throttle.acquire(1)) return reject(deferred);
+
     // run the insert in the worker
-    _worker.execute([this, collection, insert, deferred]() {
+    execute(1, [this, collection, insert, concern, deferred]() {
         try
         {
             // execute the insert
-            _mongo.insert(collection, convert(*insert));
-
-            // is anybody interested in the result?
-            if (!deferred->requireStatus())
-            {
-                // inform the listener we are done
-                _master.execute([deferred]() { deferred->complete(); });
-                return;
-            }
+            _mongo.insert(*collection, check(convert(*insert)));
 
-            // the error that could have occured
-            auto error = _mongo.getLastError();
-
-            // check whether an error occured
-            if (error.empty()) _master.execute([deferred]() { deferred->success(); });
-            else _master.execute([deferred, error]() { deferred->failure(error.c_str()); });
+            // report the result
+            acknowledge(deferred, concern);
         }
         catch (mongo::DBException& exception)
         {
@@ -348,45 +1297,54 @@ DeferredInsert& Connection::insert(const std::string& collection, const Variant:
 /**
  *  Insert a batch of documents into a collection
  *
+ *  The documents are converted to bson in the worker thread,
+ *  so the event loop is not held up by large batches.
+ *
  *  @param  collection  database name and collection
  *  @param  documents   documents to insert
  */
-DeferredInsert& Connection::insert(const std::string& collection, const std::vector<Variant::Value>& documents)
+DeferredInsert& Connection::insert(const std::string& collection, std::vector<Variant::Value>&& documents)
+{
+    // pass the namespace to the implementation
+    return insert(std::make_shared<const std::string>(collection), std::move(documents), WriteConcern());
+}
+
+/**
+ *  Insert a batch of documents into a collection
+ *
+ *  @param  collection  database name and collection
+ *  @param  documents   documents to insert
+ *  @param  concern     the write concern to wait for
+ */
+DeferredInsert& Connection::insert(const std::shared_ptr<const std::string>& collection, std::vector<Variant::Value>&& documents, const WriteConcern& concern)
 {
-    // create a new vector with the mongo objects
-    // we use a pointer to avoid needless copying
-    auto insert = std::make_shared<std::vector<mongo::BSONObj>>();
+    // move the documents to a pointer to avoid needless copying
+    auto insert = std::make_shared<std::vector<Variant::Value>>(std::move(documents));
 
     // create the deferred handler
     auto deferred = std::make_shared<DeferredInsert>();
 
-    // allocate memory for the objects
-    insert->reserve(documents.size());
-
-    // insert all documents
-    for (auto &document : documents) insert->push_back(convert(document));
+    // check whether we are within the limits
+    if (!_throttle.acquire(insert->size())) return reject(deferred);
 
     // run the insert in the worker
-    _worker.execute([this, collection, insert, deferred]() {
+    execute(insert->size(), [this, collection, insert, concern, deferred]() {
         try
         {
-            // execute the insert
-            _mongo.insert(collection, *insert);
+            // create a new vector with the mongo objects
+            std::vector<mongo::BSONObj> objects;
 
-            // is anybody interested in the result?
-            if (!deferred->requireStatus())
-            {
-                // inform the listener we are done
-                _master.execute([deferred]() { deferred->complete(); });
-                return;
-            }
+            // allocate memory for the objects
+            objects.reserve(insert->size());
 
-            // the error that could have occured
-            auto error = _mongo.getLastError();
+            // convert all documents
+            for (auto &document : *insert) objects.push_back(check(convert(document)));
+
+            // execute the insert
+            _mongo.insert(*collection, objects);
 
-            // check whether an error occured
-            if (error.empty()) _master.execute([deferred]() { deferred->success(); });
-            else _master.execute([deferred, error]() { deferred->failure(error.c_str()); });
+            // report the result
+            acknowledge(deferred, concern);
         }
         catch (mongo::DBException& exception)
         {
@@ -399,6 +1357,22 @@ DeferredInsert& Connection::insert(const std::string& collection, const std::vec
     return *deferred;
 }
 
+/**
+ *  Insert a batch of documents into a collection
+ *
+ *  Note:   This function will make a copy of the documents. This
+ *          can be useful when you want to reuse the given documents,
+ *          otherwise it is best to pass in an rvalue and avoid the copy.
+ *
+ *  @param  collection  database name and collection
+ *  @param  documents   documents to insert
+ */
+DeferredInsert& Connection::insert(const std::string& collection, const std::vector<Variant::Value>& documents)
+{
+    // move a copy to the implementation
+    return insert(collection, std::vector<Variant::Value>(documents));
+}
+
 /**
  *  Update an existing document in a collection
  *
@@ -408,6 +1382,22 @@ DeferredInsert& Connection::insert(const std::string& collection, const std::vec
  *  @param  multi       if multiple matching documents are found, update them all
  */
 DeferredUpdate& Connection::update(const std::string& collection, Variant::Value&& query, Variant::Value&& document, bool upsert, bool multi)
+{
+    // pass the namespace to the implementation
+    return update(std::make_shared<const std::string>(collection), std::move(query), std::move(document), upsert, multi, WriteConcern());
+}
+
+/**
+ *  Update an existing document in a collection
+ *
+ *  @param  collection  collection keeping the document to be updated
+ *  @param  query       the query to find the document(s) to update
+ *  @param  document    the new document to replace existing document with
+ *  @param  upsert      if no matching document was found, create one instead
+ *  @param  multi       if multiple matching documents are found, update them all
+ *  @param  concern     the write concern to wait for
+ */
+DeferredUpdate& Connection::update(const std::shared_ptr<const std::string>& collection, Variant::Value&& query, Variant::Value&& document, bool upsert, bool multi, const WriteConcern& concern)
 {
     // move the query and document to a pointer to avoid needless copying
     auto request = std::make_shared<Variant::Value>(std::move(query));
@@ -416,27 +1406,66 @@ DeferredUpdate& Connection::update(const std::string& collection, Variant::Value
     // create the deferred handler
     auto deferred = std::make_shared<DeferredUpdate>();
 
+    // can the update be collected, to be sent later?
+    if (_writeBehind.interval() > 0.0 && concern.w == 0 && !concern.journal && WriteBehind::supports(*request, *update))
+    {
+        // add it to the buffer, if it conflicts with the collected
+        // updates, those are sent first
+        if (!_writeBehind.add(*collection, *request, *update, upsert, deferred))
+        {
+            // send the collected updates, the buffer is empty afterwards
+            flush();
+            _writeBehind.add(*collection, *request, *update, upsert, deferred);
+        }
+
+        // make sure the buffer is sent
+        if (_writeBehind.schedule())
+        {
+            // the interval to wait
+            auto interval = _writeBehind.interval();
+
+            // the state shared with the timer
+            auto lifetime = _lifetime;
+
+            // wait in the timer thread, and flush from the event loop
+            _timer->execute([this, interval, lifetime]() {
+                // wait for the interval, or until the connection is destroyed
+                std::unique_lock<std::mutex> lock(lifetime->mutex);
+                if (lifetime->condition.wait_for(lock, std::chrono::duration<double>(interval), [lifetime]() { return lifetime->destroyed; })) return;
+
+                // send the updates
+                _master.execute([this, lifetime]() {
+                    // the connection may be gone by now, it flushed when destroyed
+                    if (lifetime->destroyed) return;
+
+                    // a new flush can be scheduled
+                    _writeBehind.unschedule();
+
+                    // send the updates
+                    flush();
+                });
+            });
+        }
+
+        // return the deferred handler
+        return *deferred;
+    }
+
+    // the collected updates of the collection must be applied first
+    if (_writeBehind.pending(*collection)) flush();
+
+    // check whether we are within the limits
+    if (!_throttle.acquire(1)) return reject(deferred);
+
     // run the update in the worker
-    _worker.execute([this, collection, request, update, deferred, upsert, multi]() {
+    execute(1, [this, collection, request, update, deferred, upsert, multi, concern]() {
         try
         {
             // execute the update
-            _mongo.update(collection, convert(*request), convert(*update), upsert, multi);
-
-            // is anybody interested in the result?
-            if (!deferred->requireStatus())
-            {
-                // inform the listener we are done
-                _master.execute([deferred]() { deferred->complete(); });
-                return;
-            }
-
-            // the error that could have occured
-            auto error = _mongo.getLastError();
+            _mongo.update(*collection, convert(*request), check(convert(*update)), upsert, multi);
 
-            // check whether an error occured
-            if (error.empty()) _master.execute([deferred]() { deferred->success(); });
-            else _master.execute([deferred, error]() { deferred->failure(error.c_str()); });
+            // report the result
+            acknowledge(deferred, concern);
         }
         catch (const mongo::DBException& exception)
         {
@@ -514,6 +1543,20 @@ DeferredUpdate& Connection::update(const std::string& collection, const Variant:
  *  @param  limitToOne  limit the removal to a single document
  */
 DeferredRemove& Connection::remove(const std::string& collection, Variant::Value&& query, bool limitToOne)
+{
+    // pass the namespace to the implementation
+    return remove(std::make_shared<const std::string>(collection), std::move(query), limitToOne, WriteConcern());
+}
+
+/**
+ *  Remove one or more existing documents from a collection
+ *
+ *  @param  collection  collection holding the document(s) to be removed
+ *  @param  query       the query to find the document(s) to remove
+ *  @param  limitToOne  limit the removal to a single document
+ *  @param  concern     the write concern to wait for
+ */
+DeferredRemove& Connection::remove(const std::shared_ptr<const std::string>& collection, Variant::Value&& query, bool limitToOne, const WriteConcern& concern)
 {
     // move the query to a pointer to avoid needless copying
     auto request = std::make_shared<Variant::Value>(std::move(query));
@@ -521,27 +1564,21 @@ DeferredRemove& Connection::remove(const std::string& collection, Variant::Value
     // create the deferred handler
     auto deferred = std::make_shared<DeferredRemove>();
 
+    // the collected updates of the collection must be applied first
+    if (_writeBehind.pending(*collection)) flush();
+
+    // check whether we are within the limits
+    if (!_throttle.acquire(1)) return reject(deferred);
+
     // run the remove in the worker
-    _worker.execute([this, collection, request, deferred, limitToOne]() {
+    execute(1, [this, collection, request, deferred, limitToOne, concern]() {
         try
         {
             // execute remove query
-            _mongo.remove(collection, convert(*request), limitToOne);
-
-            // is anybody interested in the result?
-            if (!deferred->requireStatus())
-            {
-                // inform the listener we are done
-                _master.execute([deferred]() { deferred->complete(); });
-                return;
-            }
-
-            // the error that could have occured
-            auto error = _mongo.getLastError();
+            _mongo.remove(*collection, convert(*request), limitToOne);
 
-            // check whether an error occured
-            if (error.empty()) _master.execute([deferred]() { deferred->success(); });
-            else _master.execute([deferred, error]() { deferred->failure(error.c_str()); });
+            // report the result
+            acknowledge(deferred, concern);
         }
         catch (const mongo::DBException& exception)
         {
@@ -571,6 +1608,17 @@ DeferredRemove& Connection::remove(const std::string& collection, const Variant:
     return remove(collection, Variant::Value(query), limitToOne);
 }
 
+/**
+ *  Get a handle to a collection
+ *
+ *  @param  collection  database name and collection
+ */
+Collection Connection::collection(const std::string& collection)
+{
+    // create the handle
+    return Collection(this, collection);
+}
+
 /**
  *  Run a command on the connection.
  *
@@ -589,8 +1637,15 @@ DeferredCommand& Connection::runCommand(const std::string& database, Variant::Va
     // create the deferred handler
     auto deferred = std::make_shared<DeferredCommand>();
 
+    // we do not know which documents a command reads or writes,
+    // so all collected updates are sent first
+    flush();
+
+    // check whether we are within the limits
+    if (!_throttle.acquire(1)) return reject(deferred);
+
     // run the command in the worker
-    _worker.execute([this, database, request, deferred]() {
+    execute(1, [this, database, request, deferred]() {
         try
         {
             // create a new mongo object, because for some reason
@@ -655,6 +1710,106 @@ DeferredCommand& Connection::runCommand(const std::string& database, const Varia
     return runCommand(database, Variant::Value(query));
 }
 
+/**
+ *  Remove a subscription after its worker stopped
+ *
+ *  @param  subscription    the subscription to remove
+ */
+void Connection::unsubscribe(Subscription *subscription)
+{
+    // find the subscription and destroy it
+    _subscriptions.remove_if([subscription](const std::unique_ptr<Subscription>& entry) { return entry.get() == subscription; });
+}
+
+/**
+ *  Start a logical session
+ *
+ *  @param  causal      should reads see the results of earlier operations?
+ */
+Session& Connection::startSession(bool causal)
+{
+    // create the session
+    _sessions.emplace_back(new Session(this, causal));
+
+    // return the session
+    return *_sessions.back();
+}
+
+/**
+ *  Remove a session after its last operation finished
+ *
+ *  @param  session     the session to remove
+ */
+void Connection::endSession(Session *session)
+{
+    // find the session and destroy it
+    _sessions.remove_if([session](const std::unique_ptr<Session>& entry) { return entry.get() == session; });
+}
+
+/**
+ *  Follow a capped collection using a tailable cursor
+ *
+ *  @param  collection  database name and capped collection
+ *  @param  query       the query to find documents to follow
+ */
+Subscription& Connection::tail(const std::string& collection, Variant::Value&& query)
+{
+    // create the subscription, it starts immediately
+    _subscriptions.emplace_back(new Subscription(this, collection, convert(query), false, mongo::BSONObj()));
+
+    // return the subscription
+    return *_subscriptions.back();
+}
+
+/**
+ *  Follow a capped collection using a tailable cursor
+ *
+ *  Note:   This function will make a copy of the query object. This
+ *          can be useful when you want to reuse the given query object,
+ *          otherwise it is best to pass in an rvalue and avoid the copy.
+ *
+ *  @param  collection  database name and capped collection
+ *  @param  query       the query to find documents to follow
+ */
+Subscription& Connection::tail(const std::string& collection, const Variant::Value& query)
+{
+    // move copy to the implementation
+    return tail(collection, Variant::Value(query));
+}
+
+/**
+ *  Watch a change stream on a collection
+ *
+ *  @param  collection  database name and collection
+ *  @param  pipeline    additional aggregation stages to filter the events
+ *  @param  token       resume token to continue after
+ */
+Subscription& Connection::watch(const std::string& collection, Variant::Value&& pipeline, const mongo::BSONObj& token)
+{
+    // create the subscription, it starts immediately
+    _subscriptions.emplace_back(new Subscription(this, collection, convert(pipeline), true, token.getOwned()));
+
+    // return the subscription
+    return *_subscriptions.back();
+}
+
+/**
+ *  Watch a change stream on a collection
+ *
+ *  Note:   This function will make a copy of the pipeline object. This
+ *          can be useful when you want to reuse the given pipeline object,
+ *          otherwise it is best to pass in an rvalue and avoid the copy.
+ *
+ *  @param  collection  database name and collection
+ *  @param  pipeline    additional aggregation stages to filter the events
+ *  @param  token       resume token to continue after
+ */
+Subscription& Connection::watch(const std::string& collection, const Variant::Value& pipeline, const mongo::BSONObj& token)
+{
+    // move copy to the implementation
+    return watch(collection, Variant::Value(pipeline), token);
+}
+
 /**
  *  End namespace
  */
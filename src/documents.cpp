@@ -0,0 +1,55 @@
+/**
+ *  Documents.cpp
+ *
+ *  A sequence of documents that is stored in a temporary file
+ *  and mapped into memory, for results that are too large to
+ *  be kept in memory.
+ *
+ *  @copyright 2014 Copernica BV
+ */
+
+#include "includes.h"
+
+/**
+ *  Set up namespace
+ */
+namespace React { namespace Mongo {
+
+/**
+ *  Constructor
+ *
+ *  @param  fd          the file holding the encoded documents
+ *  @param  size        size of the file
+ *  @param  offsets     offset of every document in the file
+ *  @throws mongo::UserException    if the file could not be mapped
+ */
+Documents::Documents(int fd, size_t size, std::vector<size_t>&& offsets) :
+    _size(size),
+    _offsets(std::move(offsets))
+{
+    // an empty file cannot be mapped, but there is nothing to read either
+    if (_size == 0) return;
+
+    // map the file, the pages are loaded when they are used
+    auto data = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+
+    // check whether that worked
+    if (data == MAP_FAILED) throw mongo::UserException(errno, strerror(errno));
+
+    // store the mapping
+    _data = static_cast<const char *>(data);
+}
+
+/**
+ *  Destructor
+ */
+Documents::~Documents()
+{
+    // release the mapping, the file was already removed
+    if (_data != nullptr) munmap(const_cast<char *>(_data), _size);
+}
+
+/**
+ *  End namespace
+ */
+}}
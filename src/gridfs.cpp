@@ -0,0 +1,444 @@
+/**
+ *  GridFS.cpp
+ *
+ *  Class to store files in and retrieve files from GridFS.
+ *  Files are streamed chunk by chunk between file descriptors
+ *  and the database, so they never have to fit in memory.
+ *
+ *  @copyright 2014 Copernica BV
+ */
+
+#include "includes.h"
+
+/**
+ *  Set up namespace
+ */
+namespace React { namespace Mongo {
+
+/**
+ *  Constructor
+ *
+ *  @param  connection  the connection to the server
+ *  @param  database    the database holding the files
+ *  @param  prefix      prefix of the files and chunks collections
+ *  @param  channels    number of parallel channels
+ *  @param  window      number of chunks to send at once
+ */
+GridFS::GridFS(Connection *connection, const std::string& database, const std::string& prefix, size_t channels, size_t window) :
+    _connection(connection),
+    _files(database + "." + prefix + ".files"),
+    _chunks(database + "." + prefix + ".chunks"),
+    _window(std::max<size_t>(window, 1)),
+    _indexed(false)
+{
+    // create all channels
+    for (size_t i = 0; i < std::max<size_t>(channels, 1); ++i)
+    {
+        // create the channel
+        auto channel = new Channel();
+
+        // store it
+        _channels.emplace_back(channel);
+
+        // connect to mongo, failures are reported by the operations
+        // themselves, as the connection automatically reconnects
+        channel->worker.execute([this, channel, i]() {
+            try
+            {
+                // connect throws an exception on failure
+                Resolver::connect(channel->mongo, _connection->_host);
+
+                // the first channel makes sure the indexes exist
+                if (i == 0) index(channel);
+            }
+            catch (const mongo::DBException&) {}
+        });
+    }
+}
+
+/**
+ *  Create the indexes on the files and chunks collections, unless
+ *  that was already done
+ *
+ *  @param  channel     the channel to use
+ */
+void GridFS::index(Channel *channel)
+{
+    // already done?
+    if (_indexed) return;
+
+    try
+    {
+        // the chunks are looked up by file and number, and every number
+        // may only be used once per file
+        channel->mongo.ensureIndex(_chunks, BSON("files_id" << 1 << "n" << 1), true);
+
+        // the files are looked up by name and date
+        channel->mongo.ensureIndex(_files, BSON("filename" << 1 << "uploadDate" << 1));
+
+        // done, the other channels may have done the same in the meantime,
+        // but creating an index that exists is harmless
+        _indexed = true;
+    }
+    catch (const mongo::DBException&)
+    {
+        // the transfers work without the indexes, we try again next time
+    }
+}
+
+/**
+ *  Store a file, reading the data with a function
+ *
+ *  @param  filename    the name to store the file under
+ *  @param  reader      function reading the data of the next chunk
+ *  @param  chunkSize   size of the chunks to store the data in
+ */
+DeferredUpload& GridFS::store(const std::string& filename, const std::function<ssize_t(const char *&data)>& reader, size_t chunkSize)
+{
+    // create the deferred handler
+    auto deferred = std::make_shared<DeferredUpload>();
+
+    // the channel to upload over
+    auto channel = _channels[_next++ % _channels.size()].get();
+
+    // run the upload in the worker
+    channel->worker.execute([this, channel, filename, reader, chunkSize, deferred]() {
+        // the id of the new file
+        auto id = mongo::OID::gen();
+
+        // have chunks been sent to the server?
+        bool sent = false;
+
+        // remove the chunks that were stored when the upload fails,
+        // so that they do not remain in the collection without a file
+        auto discard = [this, channel, &id, &sent]() {
+            try { if (sent) channel->mongo.remove(_chunks, BSON("files_id" << id)); }
+            catch (const mongo::DBException&) {}
+        };
+
+        try
+        {
+            // make sure the indexes exist
+            index(channel);
+
+            // the chunks to send in one go
+            std::vector<mongo::BSONObj> window;
+            window.reserve(_window);
+
+            // number of bytes stored so far, and the number of the next chunk
+            size_t length = 0;
+            int n = 0;
+
+            // keep going until we have read all data
+            for (bool finished = false; !finished; )
+            {
+                // fill the window
+                while (window.size() < _window)
+                {
+                    // read the next chunk
+                    const char *data = nullptr;
+                    auto size = reader(data);
+
+                    // check for failure
+                    if (size < 0)
+                    {
+                        // the data could not be read
+                        auto error = std::string("Failed reading data: ") + strerror(errno);
+                        discard();
+                        _connection->_master.execute([deferred, error]() { deferred->failure(error.c_str()); });
+                        return;
+                    }
+
+                    // is this the end of the data?
+                    if (size == 0) { finished = true; break; }
+
+                    // create the chunk
+                    mongo::BSONObjBuilder chunk;
+                    chunk.append("_id", mongo::OID::gen());
+                    chunk.append("files_id", id);
+                    chunk.append("n", n++);
+                    chunk.appendBinData("data", (int)size, mongo::BinDataGeneral, data);
+
+                    // add to the window
+                    window.push_back(chunk.obj());
+
+                    // we have now read more data
+                    length += size;
+
+                    // a short chunk is the last one
+                    if ((size_t)size < chunkSize) { finished = true; break; }
+                }
+
+                // anything to send?
+                if (window.empty()) break;
+
+                // send the chunks
+                sent = true;
+                channel->mongo.insert(_chunks, window);
+                window.clear();
+
+                // stop if the chunks could not be stored
+                auto error = channel->mongo.getLastError();
+                if (!error.empty())
+                {
+                    // remove what was stored, and report the failure
+                    discard();
+                    _connection->_master.execute([deferred, error]() { deferred->failure(error.c_str()); });
+                    return;
+                }
+            }
+
+            // all chunks are stored, now we can add the file
+            mongo::BSONObjBuilder file;
+            file.append("_id", id);
+            file.append("length", (long long)length);
+            file.append("chunkSize", (int)chunkSize);
+            file.appendDate("uploadDate", mongo::jsTime());
+            file.append("filename", filename);
+
+            // store the file
+            channel->mongo.insert(_files, file.obj());
+
+            // check whether that succeeded
+            auto error = channel->mongo.getLastError();
+            if (error.empty()) _connection->_master.execute([deferred, length]() { deferred->success(length); });
+            else { discard(); _connection->_master.execute([deferred, error]() { deferred->failure(error.c_str()); }); }
+        }
+        catch (const mongo::DBException& exception)
+        {
+            // remove what was stored, and inform the listener of the failure
+            discard();
+            _connection->_master.execute([deferred, exception]() { deferred->failure(exception.toString().c_str()); });
+        }
+    });
+
+    // return the deferred handler
+    return *deferred;
+}
+
+/**
+ *  Store a file, reading the data from a file descriptor
+ *
+ *  @param  filename    the name to store the file under
+ *  @param  fd          file descriptor to read the data from
+ *  @param  chunkSize   size of the chunks to store the data in
+ */
+DeferredUpload& GridFS::upload(const std::string& filename, int fd, size_t chunkSize)
+{
+    // the buffer to read a chunk into, the worker uses it one chunk at a time
+    auto buffer = std::make_shared<std::vector<char>>(chunkSize);
+
+    // store the file
+    return store(filename, [fd, buffer](const char *&data) -> ssize_t {
+        // the number of bytes read into the buffer
+        size_t size = 0;
+
+        // keep reading until the chunk is full
+        while (size < buffer->size())
+        {
+            // read more data
+            auto result = ::read(fd, buffer->data() + size, buffer->size() - size);
+
+            // check for the end of the file and for failures
+            if (result == 0) break;
+            if (result < 0 && errno == EINTR) continue;
+            if (result < 0) return -1;
+
+            // we have read more data
+            size += result;
+        }
+
+        // the chunk is in the buffer
+        data = buffer->data();
+        return size;
+    }, chunkSize);
+}
+
+/**
+ *  Store a file, reading the data from a buffer
+ *
+ *  @param  filename    the name to store the file under
+ *  @param  buffer      the data to store
+ *  @param  size        size of the data
+ *  @param  chunkSize   size of the chunks to store the data in
+ */
+DeferredUpload& GridFS::upload(const std::string& filename, const char *buffer, size_t size, size_t chunkSize)
+{
+    // the offset of the next chunk, the worker uses it one chunk at a time
+    auto offset = std::make_shared<size_t>(0);
+
+    // store the file
+    return store(filename, [buffer, size, offset, chunkSize](const char *&data) -> ssize_t {
+        // the chunk is read straight from the buffer
+        data = buffer + *offset;
+
+        // the size of the chunk
+        auto result = std::min(chunkSize, size - *offset);
+
+        // the next chunk starts after this one
+        *offset += result;
+        return result;
+    }, chunkSize);
+}
+
+/**
+ *  Retrieve a file, writing the data to a file descriptor
+ *
+ *  @param  filename    the name of the file to retrieve
+ *  @param  fd          file descriptor to write the data to
+ */
+DeferredDownload& GridFS::download(const std::string& filename, int fd)
+{
+    // create the deferred handler
+    auto deferred = std::make_shared<DeferredDownload>();
+
+    // the first channel looks up the file
+    auto channel = _channels.front().get();
+
+    // run the download in the worker
+    channel->worker.execute([this, channel, filename, fd, deferred]() {
+        try
+        {
+            // make sure the indexes exist
+            index(channel);
+
+            // find the most recent version of the file
+            auto file = channel->mongo.findOne(_files, mongo::Query(BSON("filename" << filename)).sort("uploadDate", -1));
+
+            // did we find it?
+            if (file.isEmpty())
+            {
+                // there is no such file
+                _connection->_master.execute([deferred]() { deferred->failure("File not found"); });
+                return;
+            }
+
+            // the properties of the file
+            size_t length = file["length"].numberLong();
+            size_t chunkSize = file["chunkSize"].numberInt();
+            size_t chunks = chunkSize == 0 ? 0 : (length + chunkSize - 1) / chunkSize;
+
+            // an empty file needs no chunks
+            if (chunks == 0)
+            {
+                // we're done already
+                _connection->_master.execute([deferred]() { deferred->success(0); });
+                return;
+            }
+
+            // the state shared by all channels
+            struct Transfer
+            {
+                std::atomic<size_t> pending;
+                std::mutex mutex;
+                std::string error;
+            };
+
+            // every channel fetches a range of chunks
+            auto count = std::min(_channels.size(), chunks);
+            auto transfer = std::make_shared<Transfer>();
+            transfer->pending = count;
+
+            // the id of the file, it is referenced by the chunks
+            auto id = file["_id"].wrap("files_id");
+
+            // divide the chunks over the channels
+            for (size_t i = 0; i < count; ++i)
+            {
+                // the range of chunks for this channel
+                int first = chunks * i / count;
+                int last = chunks * (i + 1) / count;
+
+                // the channel to use
+                auto fetcher = _channels[i].get();
+
+                // fetch the range
+                fetcher->worker.execute([this, fetcher, id, first, last, chunks, chunkSize, length, fd, transfer, deferred]() {
+                    try
+                    {
+                        // the chunks to retrieve
+                        mongo::BSONObjBuilder query;
+                        query.appendElements(id);
+                        query.append("n", BSON("$gte" << first << "$lt" << last));
+
+                        // retrieve the chunks, they are written as they come in
+                        auto cursor = fetcher->mongo.query(_chunks, query.obj());
+
+                        // the driver returns nothing on connection failures
+                        if (cursor.get() == NULL) throw mongo::UserException(0, "Unspecified connection error");
+
+                        // number of chunks received
+                        int received = 0;
+
+                        // process all chunks
+                        while (cursor->more())
+                        {
+                            // the next chunk, and its number
+                            auto chunk = cursor->next();
+                            size_t n = chunk["n"].numberInt();
+
+                            // the data in the chunk
+                            int size = 0;
+                            const char *data = chunk["data"].binData(size);
+
+                            // all chunks are full, except for the last one
+                            size_t expected = n + 1 == chunks ? length - n * chunkSize : chunkSize;
+                            if ((size_t)size != expected) throw mongo::UserException(0, "Chunk " + std::to_string(n) + " has the wrong size");
+
+                            // we received another chunk
+                            received += 1;
+
+                            // write the data at the position of the chunk
+                            off_t offset = (off_t)n * chunkSize;
+                            while (size > 0)
+                            {
+                                // write the data
+                                auto result = ::pwrite(fd, data, size, offset);
+
+                                // retry when interrupted
+                                if (result < 0 && errno == EINTR) continue;
+
+                                // other failures are fatal
+                                if (result < 0) throw mongo::UserException(errno, std::string("Failed writing data: ") + strerror(errno));
+
+                                // we have written more data
+                                data += result;
+                                size -= result;
+                                offset += result;
+                            }
+                        }
+
+                        // a file with missing chunks would have holes in it
+                        if (received != last - first) throw mongo::UserException(0, "Chunks of the file are missing");
+                    }
+                    catch (const mongo::DBException& exception)
+                    {
+                        // remember the failure
+                        std::lock_guard<std::mutex> lock(transfer->mutex);
+                        transfer->error = exception.toString();
+                    }
+
+                    // are there other channels still running?
+                    if (--transfer->pending > 0) return;
+
+                    // this was the last channel, report the result
+                    if (transfer->error.empty()) _connection->_master.execute([deferred, length]() { deferred->success(length); });
+                    else _connection->_master.execute([deferred, transfer]() { deferred->failure(transfer->error.c_str()); });
+                });
+            }
+        }
+        catch (const mongo::DBException& exception)
+        {
+            // inform the listener of the failure
+            _connection->_master.execute([deferred, exception]() { deferred->failure(exception.toString().c_str()); });
+        }
+    });
+
+    // return the deferred handler
+    return *deferred;
+}
+
+/**
+ *  End namespace
+ */
+}}
@@ -15,9 +15,48 @@
 #include <string>
 #include <vector>
 #include <functional>
+#include <memory>
+#include <list>
+#include <deque>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <map>
+#include <set>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <stdexcept>
+#include <limits>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <random>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <poll.h>
 
 /**
  *  Include other files from this library
  */
 #include "../include/deferred.h"
+#include "../include/resolver.h"
+#include "../include/writeconcern.h"
+#include "../include/modifyoptions.h"
+#include "../include/throttle.h"
+#include "../include/profiler.h"
+#include "../include/writebehind.h"
+#include "../include/validator.h"
+#include "../include/documents.h"
+#include "../include/mapping.h"
+#include "../include/preparedquery.h"
+#include "../include/subscription.h"
+#include "../include/session.h"
 #include "../include/connection.h"
+#include "../include/collection.h"
+#include "../include/gridfs.h"
+#include "../include/transfer.h"
+#include "../include/pool.h"
@@ -0,0 +1,82 @@
+/**
+ *  Pool.cpp
+ *
+ *  A set of connections for applications that run an event
+ *  loop in every thread. Every loop gets its own connections,
+ *  so the results of an operation are delivered on the loop
+ *  that started it, without passing through other threads.
+ *
+ *  @copyright 2014 Copernica BV
+ */
+
+#include "includes.h"
+
+/**
+ *  Set up namespace
+ */
+namespace React { namespace Mongo {
+
+/**
+ *  Constructor
+ *
+ *  @param  loops       the loops to create connections for
+ *  @param  host        the host to connect to
+ *  @param  connections number of connections per loop
+ */
+Pool::Pool(const std::vector<React::Loop*>& loops, const std::string& host, size_t connections)
+{
+    // every loop needs at least one connection
+    if (connections == 0) connections = 1;
+
+    // we know how many loops there are
+    _shards.reserve(loops.size());
+
+    // create the connections for all loops
+    for (auto loop : loops)
+    {
+        // the connections of this loop
+        _shards.emplace_back(new Shard(loop));
+        auto &shard = *_shards.back();
+
+        // create them, they connect in their own workers
+        shard.connections.reserve(connections);
+        for (size_t i = 0; i < connections; ++i) shard.connections.emplace_back(new Connection(loop, host));
+    }
+}
+
+/**
+ *  Get a call for every connection of a loop, when it succeeds or fails
+ *
+ *  @param  index       index of the loop
+ *  @param  callback    the callback that will be informed of the connection status
+ */
+void Pool::onConnected(size_t index, const std::function<void(const char *error)>& callback)
+{
+    // register the callback with all connections of the loop
+    for (auto &connection : _shards[index]->connections) connection->onConnected(callback);
+}
+
+/**
+ *  Get the next connection of a loop
+ *
+ *  @param  loop        the loop to get a connection for
+ *  @return Connection
+ *  @throws std::invalid_argument   if the loop is not part of the pool
+ */
+Connection& Pool::connection(React::Loop *loop)
+{
+    // find the loop, there are only as many as there are cores
+    for (size_t i = 0; i < _shards.size(); ++i)
+    {
+        // is this the one?
+        if (_shards[i]->loop == loop) return connection(i);
+    }
+
+    // the loop is not ours
+    throw std::invalid_argument("Loop is not part of the pool");
+}
+
+/**
+ *  End namespace
+ */
+}}
@@ -0,0 +1,249 @@
+/**
+ *  PreparedQuery.cpp
+ *
+ *  A query that has been converted to bson once, with
+ *  a number of parameter slots that can be filled in
+ *  for every execution without converting it again.
+ *
+ *  @copyright 2014 Copernica BV
+ */
+
+#include "includes.h"
+
+/**
+ *  Set up namespace
+ */
+namespace React { namespace Mongo {
+
+/**
+ *  Write a number in little endian byte order, which
+ *  is the byte order used by bson on every platform
+ *
+ *  @param  buffer      the buffer to write to
+ *  @param  value       the value to write
+ *  @param  size        number of bytes to write
+ */
+static void store(char *buffer, uint64_t value, size_t size)
+{
+    // write the bytes one at a time, least significant first
+    for (size_t i = 0; i < size; ++i) buffer[i] = (char)((value >> (8 * i)) & 0xff);
+}
+
+/**
+ *  Read a 32-bit number in little endian byte order
+ *
+ *  @param  buffer      the buffer to read from
+ *  @return int32_t
+ */
+static int32_t load(const char *buffer)
+{
+    // the bytes as unsigned values
+    auto bytes = reinterpret_cast<const unsigned char *>(buffer);
+
+    // combine the bytes
+    return (int32_t)((uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24));
+}
+
+/**
+ *  Constructor
+ *
+ *  @param  query       the encoded query template
+ *  @param  parameters  the paths of the parameters in the query
+ *  @throws std::invalid_argument   if a parameter cannot be found, is not supported, or overlaps another
+ */
+PreparedQuery::PreparedQuery(const mongo::BSONObj& query, const std::vector<std::string>& parameters) :
+    _template(query.getOwned())
+{
+    // the slots we are going to find
+    auto slots = std::make_shared<std::vector<Slot>>();
+
+    // the start of the encoded data, to calculate offsets with
+    const char *data = _template.objdata();
+
+    // allocate memory for the slots
+    slots->reserve(parameters.size());
+
+    // look up all parameters
+    for (auto &path : parameters)
+    {
+        // a value can only be replaced by a single parameter, so the same path
+        // may not be given twice, nor a path that lies inside another one
+        for (auto &other : parameters)
+        {
+            // stop at the path itself, the earlier paths are compared
+            if (&other == &path) break;
+
+            // the shortest of both must not be a prefix of the longest
+            auto &shortest = other.size() < path.size() ? other : path;
+            auto &longest = other.size() < path.size() ? path : other;
+            if (longest.compare(0, shortest.size(), shortest) != 0) continue;
+            if (longest.size() == shortest.size() || longest[shortest.size()] == '.') throw std::invalid_argument("parameters " + other + " and " + path + " overlap");
+        }
+
+        // find the element in the template
+        auto element = _template.getFieldDotted(path);
+
+        // the element must exist
+        if (element.eoo()) throw std::invalid_argument("parameter " + path + " not found in query");
+
+        // the slot to fill
+        Slot slot;
+
+        // remember which parameter goes in here
+        slot.parameter = slots->size();
+
+        // store the type and position
+        slot.type = element.type();
+        slot.offset = element.value() - data;
+
+        // determine the size of the value
+        switch (slot.type)
+        {
+            case mongo::NumberInt:      slot.size = 4;                                  break;
+            case mongo::NumberDouble:   slot.size = 8;                                  break;
+            case mongo::Bool:           slot.size = 1;                                  break;
+            case mongo::String:         slot.size = 4 + element.valuestrsize();         break;
+            default:
+                throw std::invalid_argument("parameter " + path + " has an unsupported type");
+        }
+
+        // the top-level document always holds the value
+        slot.parents.push_back(0);
+
+        // find all the embedded documents leading up to the value
+        for (auto dot = path.find('.'); dot != std::string::npos; dot = path.find('.', dot + 1))
+        {
+            // the document on this level
+            auto parent = _template.getFieldDotted(path.substr(0, dot));
+
+            // store the offset of its length header
+            slot.parents.push_back(parent.value() - data);
+        }
+
+        // add the slot
+        slots->push_back(std::move(slot));
+    }
+
+    // we store the slots by offset, so we can copy the template front to back
+    std::sort(slots->begin(), slots->end(), [](const Slot &a, const Slot &b) { return a.offset < b.offset; });
+
+    // store the slots
+    _slots = slots;
+}
+
+/**
+ *  Fill in the parameters and write the resulting
+ *  bson query to the given buffer.
+ *
+ *  @param  values      the parameter values, in the order of the paths given to the constructor
+ *  @param  buffer      the buffer to write the encoded query to
+ *  @return bool        false if the wrong number of values was given
+ */
+bool PreparedQuery::bind(const std::vector<Variant::Value>& values, std::string& buffer) const
+{
+    // we need a value for every slot
+    if (values.size() != _slots->size()) return false;
+
+    // the template data
+    const char *data = _template.objdata();
+
+    // the difference in size for every slot
+    std::vector<int32_t> deltas(_slots->size(), 0);
+
+    // we will probably end up about the same size as the template
+    buffer.clear();
+    buffer.reserve(_template.objsize() + 64);
+
+    // the position in the template up to which we copied
+    size_t position = 0;
+
+    // process all slots in the order they appear
+    for (size_t i = 0; i < _slots->size(); ++i)
+    {
+        // the slot and the value that goes in there
+        auto &slot = (*_slots)[i];
+        auto &value = values[slot.parameter];
+
+        // copy the template up to the slot
+        buffer.append(data + position, slot.offset - position);
+
+        // skip over the template value
+        position = slot.offset + slot.size;
+
+        // the bytes for the fixed size types
+        char bytes[8];
+
+        // encode the value as the type of the slot
+        switch (slot.type)
+        {
+            case mongo::NumberInt:
+                store(bytes, (uint32_t)(int)value, 4);
+                buffer.append(bytes, 4);
+                break;
+
+            case mongo::NumberDouble: {
+                // the double, in its binary representation
+                double number = value;
+                uint64_t binary;
+                memcpy(&binary, &number, 8);
+
+                // and add it
+                store(bytes, binary, 8);
+                buffer.append(bytes, 8);
+                break;
+            }
+
+            case mongo::Bool:
+                buffer.push_back((bool)value ? 1 : 0);
+                break;
+
+            case mongo::String: {
+                // the string to store
+                std::string string = value;
+
+                // strings are stored with their length (including the terminator)
+                store(bytes, string.size() + 1, 4);
+                buffer.append(bytes, 4);
+                buffer.append(string.data(), string.size());
+                buffer.push_back('\0');
+
+                // the string may have changed in size
+                deltas[i] = (int32_t)(string.size() + 5) - (int32_t)slot.size;
+                break;
+            }
+
+            default:
+                // cannot happen, the constructor only accepts the types above
+                break;
+        }
+    }
+
+    // copy the rest of the template
+    buffer.append(data + position, _template.objsize() - position);
+
+    // update the length headers for values that changed in size
+    for (size_t i = 0; i < _slots->size(); ++i)
+    {
+        // nothing to do if the size did not change
+        if (deltas[i] == 0) continue;
+
+        // update all documents holding the value
+        for (auto parent : (*_slots)[i].parents)
+        {
+            // the header shifted by all the changes made before it
+            size_t offset = parent;
+            for (size_t j = 0; j < _slots->size() && (*_slots)[j].offset < parent; ++j) offset += deltas[j];
+
+            // update the length
+            store(&buffer[offset], (uint32_t)(load(&buffer[offset]) + deltas[i]), 4);
+        }
+    }
+
+    // done
+    return true;
+}
+
+/**
+ *  End namespace
+ */
+}}
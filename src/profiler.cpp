@@ -0,0 +1,211 @@
+/**
+ *  Profiler.cpp
+ *
+ *  Classes to measure how long queries take, and to report
+ *  the ones that take longer than a threshold.
+ *
+ *  @copyright 2014 Copernica BV
+ */
+
+#include "includes.h"
+
+/**
+ *  Set up namespace
+ */
+namespace React { namespace Mongo {
+
+/**
+ *  Set the threshold and the callback, this is called from the event loop
+ *
+ *  @param  threshold   threshold in milliseconds
+ *  @param  callback    the callback, or an empty function to stop profiling
+ *  @param  explain     should slow shapes be explained?
+ */
+void Profiler::set(double threshold, const std::function<void(const SlowOperation&)>& callback, bool explain)
+{
+    // store the callback, it is only used on the event loop
+    _callback = callback;
+
+    // the worker only measures when there is a callback
+    _explain = explain;
+    _threshold = callback ? std::max(threshold, 0.0) : -1.0;
+}
+
+/**
+ *  Find a shape, or add it when it is not known, and mark it
+ *  as the most recently used one
+ *
+ *  @param  description the description of the shape
+ *  @return Shape
+ */
+Profiler::Shape &Profiler::find(const std::string& description)
+{
+    // look up the shape
+    auto iter = _shapes.find(description);
+
+    // a known shape moves to the front
+    if (iter != _shapes.end())
+    {
+        _recent.splice(_recent.begin(), _recent, iter->second.recent);
+        return iter->second;
+    }
+
+    // forget the shape that was not slow for the longest time
+    if (_shapes.size() >= maxShapes)
+    {
+        _shapes.erase(_recent.back());
+        _recent.pop_back();
+    }
+
+    // add the new shape in front
+    _recent.push_front(description);
+    auto &shape = _shapes[description];
+    shape.recent = _recent.begin();
+
+    // done
+    return shape;
+}
+
+/**
+ *  Add a slow operation to the statistics of its shape
+ *
+ *  @param  operation   the slow operation
+ *  @return bool        true if the shape should be explained now
+ */
+bool Profiler::record(SlowOperation& operation)
+{
+    // find the shape, or add it when it was not slow before
+    auto &shape = find(operation.shape);
+
+    // count the operation
+    operation.occurrences = ++shape.occurrences;
+
+    // use the plan we already have
+    if (shape.explained) operation.explain = shape.explain;
+
+    // explain the shape if that was not done yet
+    return _explain && !shape.explained;
+}
+
+/**
+ *  Store the plan of a shape
+ *
+ *  @param  shape       the shape that was explained
+ *  @param  plan        the plan of the shape
+ */
+void Profiler::explained(const std::string& shape, const Variant::Value& plan)
+{
+    // find the shape
+    auto &stats = find(shape);
+
+    // store the plan, it is not requested again
+    stats.explained = true;
+    stats.explain = plan;
+}
+
+/**
+ *  Pass a slow operation to the callback on the event loop
+ *
+ *  @param  operation   the slow operation
+ */
+void Profiler::report(std::shared_ptr<SlowOperation>&& operation)
+{
+    // the callback may have been removed in the meantime
+    _master.execute([this, operation]() { if (_callback) _callback(*operation); });
+}
+
+/**
+ *  Describe an object without its values
+ *
+ *  @param  object      the object to describe
+ *  @param  result      the string to append to
+ */
+void Profiler::describe(const mongo::BSONObj &object, std::string &result)
+{
+    // an empty object
+    if (object.isEmpty()) { result.append("{}"); return; }
+
+    // start the object
+    result.append("{ ");
+
+    // process all elements
+    for (auto iter = object.begin(); iter.more(); )
+    {
+        // the element to describe
+        auto element = iter.next();
+
+        // add the field name
+        result.append(element.fieldName());
+        result.append(": ");
+
+        // check the value
+        switch (element.type())
+        {
+            case mongo::Object:
+                // operators and nested documents keep their structure
+                describe(element.Obj(), result);
+                break;
+
+            case mongo::Array: {
+                // the array to describe
+                auto array = element.Obj();
+
+                // lists of values, like for $in, collapse to a single
+                // placeholder, lists of conditions, like for $or, are
+                // described one by one
+                if (array.isEmpty() || array.firstElement().type() != mongo::Object) { result.append("[?]"); break; }
+
+                // describe all conditions
+                result.append("[ ");
+                for (auto item = array.begin(); item.more(); )
+                {
+                    // the next condition
+                    auto condition = item.next();
+
+                    // describe it
+                    if (condition.type() == mongo::Object) describe(condition.Obj(), result);
+                    else result.append("?");
+
+                    // separate the conditions
+                    if (item.more()) result.append(", ");
+                }
+                result.append(" ]");
+                break;
+            }
+
+            default:
+                // all other values are replaced
+                result.append("?");
+                break;
+        }
+
+        // separate the elements
+        if (iter.more()) result.append(", ");
+    }
+
+    // end the object
+    result.append(" }");
+}
+
+/**
+ *  Describe a query without its values
+ *
+ *  @param  query       the query to describe
+ *  @return std::string
+ */
+std::string Profiler::shape(const mongo::BSONObj& query)
+{
+    // the description
+    std::string result;
+
+    // describe the query
+    describe(query, result);
+
+    // done
+    return result;
+}
+
+/**
+ *  End namespace
+ */
+}}
@@ -0,0 +1,249 @@
+/**
+ *  Resolver.cpp
+ *
+ *  Class connecting to a host. When the driver cannot connect and
+ *  the host name has multiple addresses, they are tried in parallel,
+ *  with a short delay between the attempts, and the first one that
+ *  accepts the connection is used.
+ *
+ *  @copyright 2014 Copernica BV
+ */
+
+#include "includes.h"
+
+/**
+ *  Set up namespace
+ */
+namespace React { namespace Mongo {
+
+/**
+ *  The remembered addresses by host
+ */
+struct Cache
+{
+    std::mutex mutex;
+    std::map<std::string, std::pair<std::string, std::chrono::steady_clock::time_point>> addresses;
+};
+
+/**
+ *  The cache shared by all connections
+ *
+ *  @return Cache
+ */
+static Cache &cache()
+{
+    static Cache cache;
+    return cache;
+}
+
+/**
+ *  Try to connect to all addresses, and return the first that accepts
+ *
+ *  @param  addresses   the addresses of the host
+ *  @param  delay       milliseconds to wait before the next address is tried
+ *  @return the address, or a null pointer if none accepted
+ */
+const struct addrinfo *Resolver::race(const struct addrinfo *addresses, int delay)
+{
+    // the addresses of the first family and the others
+    std::vector<const struct addrinfo *> preferred, others;
+    for (auto address = addresses; address; address = address->ai_next) (address->ai_family == addresses->ai_family ? preferred : others).push_back(address);
+
+    // the families take turns, so a broken family does not delay us much
+    std::vector<const struct addrinfo *> candidates;
+    for (size_t i = 0; i < std::max(preferred.size(), others.size()); ++i)
+    {
+        if (i < preferred.size()) candidates.push_back(preferred[i]);
+        if (i < others.size()) candidates.push_back(others[i]);
+    }
+
+    // the pending attempts, and the address of each of them
+    std::vector<struct pollfd> sockets;
+    std::vector<const struct addrinfo *> attempts;
+
+    // the next candidate to try, and the one that accepted
+    size_t next = 0;
+    const struct addrinfo *winner = nullptr;
+
+    // continue until there is a winner or nothing left to try
+    while (winner == nullptr && (next < candidates.size() || !sockets.empty()))
+    {
+        // start the next attempt
+        if (next < candidates.size())
+        {
+            // the candidate to try
+            auto candidate = candidates[next++];
+
+            // create a non-blocking socket and start connecting
+            int fd = socket(candidate->ai_family, candidate->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, candidate->ai_protocol);
+            if (fd < 0) continue;
+
+            // connecting to a local address may succeed right away
+            if (::connect(fd, candidate->ai_addr, candidate->ai_addrlen) == 0) { close(fd); winner = candidate; break; }
+
+            // otherwise wait for it, unless it failed right away
+            if (errno != EINPROGRESS) { close(fd); continue; }
+            sockets.push_back(pollfd{ fd, POLLOUT, 0 });
+            attempts.push_back(candidate);
+        }
+
+        // nothing to wait for
+        if (sockets.empty()) continue;
+
+        // wait for an attempt to finish, but only shortly if more can be started
+        int ready = poll(sockets.data(), sockets.size(), next < candidates.size() ? delay : 10000);
+
+        // the next candidate is started when nothing happened in time,
+        // but without any candidates left we give up
+        if (ready == 0 && next >= candidates.size()) break;
+        if (ready <= 0) continue;
+
+        // check the attempts that finished
+        for (size_t i = 0; i < sockets.size(); )
+        {
+            // skip the attempts that are still pending
+            if (sockets[i].revents == 0) { ++i; continue; }
+
+            // did the connection succeed?
+            int error = 0;
+            socklen_t length = sizeof(error);
+            if (getsockopt(sockets[i].fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0 && winner == nullptr) winner = attempts[i];
+
+            // the socket was only used to try the address
+            close(sockets[i].fd);
+            sockets.erase(sockets.begin() + i);
+            attempts.erase(attempts.begin() + i);
+        }
+    }
+
+    // close the attempts that lost
+    for (auto &socket : sockets) close(socket.fd);
+
+    // done
+    return winner;
+}
+
+/**
+ *  The remembered address of a host
+ *
+ *  @param  host        host name, optionally followed by a colon and the port
+ *  @return the numeric address and port, or an empty string if there is none
+ */
+std::string Resolver::remembered(const std::string& host)
+{
+    // check whether we remember the address, and it did not expire
+    std::lock_guard<std::mutex> lock(cache().mutex);
+    auto iter = cache().addresses.find(host);
+    if (iter != cache().addresses.end() && iter->second.second > std::chrono::steady_clock::now()) return iter->second.first;
+
+    // we do not know it
+    return std::string();
+}
+
+/**
+ *  Find the address that accepts connections first
+ *
+ *  @param  host        host name, optionally followed by a colon and the port
+ *  @return the numeric address and port, or an empty string if none accepted
+ */
+std::string Resolver::lookup(const std::string& host)
+{
+    // split the name and the port, names with multiple colons are
+    // ipv6 addresses, which only have a port when they use brackets
+    std::string name(host), port("27017");
+    auto colon = host.rfind(':');
+    if (!host.empty() && host[0] == '[' && colon != std::string::npos && colon > 0 && host[colon - 1] == ']') { name = host.substr(1, colon - 2); port = host.substr(colon + 1); }
+    else if (colon != std::string::npos && host.find(':') == colon) { name = host.substr(0, colon); port = host.substr(colon + 1); }
+
+    // we want stream sockets, the driver only connects to ipv6
+    // addresses when it was enabled, so otherwise we only use ipv4
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = mongo::IPv6Enabled() ? AF_UNSPEC : AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    // look up the addresses
+    struct addrinfo *addresses = nullptr;
+    if (getaddrinfo(name.c_str(), port.c_str(), &hints, &addresses) != 0) return std::string();
+
+    // with a single address there is nothing the driver did not try already
+    auto winner = addresses->ai_next == nullptr ? nullptr : race(addresses, 250);
+
+    // the numeric address of the winner
+    char buffer[NI_MAXHOST];
+    bool found = winner != nullptr && getnameinfo(winner->ai_addr, winner->ai_addrlen, buffer, sizeof(buffer), nullptr, 0, NI_NUMERICHOST) == 0;
+    bool ipv6 = found && winner->ai_family == AF_INET6;
+
+    // we no longer need the addresses
+    freeaddrinfo(addresses);
+
+    // did any address accept?
+    if (!found) return std::string();
+
+    // the address in a format the driver understands
+    auto address = ipv6 ? std::string("[") + buffer + "]:" + port : std::string(buffer) + ":" + port;
+
+    // remember it for a minute
+    std::lock_guard<std::mutex> lock(cache().mutex);
+    cache().addresses[host] = std::make_pair(address, std::chrono::steady_clock::now() + std::chrono::seconds(60));
+
+    // done
+    return address;
+}
+
+/**
+ *  Connect to a host
+ *
+ *  @param  connection  the connection to connect
+ *  @param  host        host name, optionally followed by a colon and the port
+ *  @throws mongo::DBException  if the host could not be reached
+ */
+void Resolver::connect(mongo::DBClientConnection& connection, const std::string& host)
+{
+    // an address that won a race before is tried first
+    auto address = remembered(host);
+    if (!address.empty())
+    {
+        // connect throws an exception on failure
+        try { connection.connect(address); return; }
+
+        // the address should be looked up again
+        catch (const mongo::DBException&) { forget(host); }
+    }
+
+    try
+    {
+        // let the driver connect as usual, this is what happens for
+        // healthy hosts, so they do not pay for the race
+        connection.connect(host);
+    }
+    catch (const mongo::DBException&)
+    {
+        // the driver only tries the first address, so we try all of them
+        address = lookup(host);
+
+        // without another address that accepts, the failure stands
+        if (address.empty()) throw;
+
+        // connect to the winner, this reaches a server that just accepted
+        try { connection.connect(address); }
+        catch (const mongo::DBException&) { forget(host); throw; }
+    }
+}
+
+/**
+ *  Forget the address of a host, after connecting to it failed
+ *
+ *  @param  host        host name, optionally followed by a colon and the port
+ */
+void Resolver::forget(const std::string& host)
+{
+    // remove it from the cache
+    std::lock_guard<std::mutex> lock(cache().mutex);
+    cache().addresses.erase(host);
+}
+
+/**
+ *  End namespace
+ */
+}}
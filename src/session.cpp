@@ -0,0 +1,624 @@
+/**
+ *  Session.cpp
+ *
+ *  A logical session on a connection, for causally consistent
+ *  reads and for multi-document transactions. All operations
+ *  in a session run as commands on the connection's worker,
+ *  in the order in which they were started.
+ *
+ *  @copyright 2014 Copernica BV
+ */
+
+#include "includes.h"
+
+/**
+ *  Set up namespace
+ */
+namespace React { namespace Mongo {
+
+/**
+ *  Constructor
+ *
+ *  @param  connection  the connection we belong to
+ *  @param  causal      should reads see the results of earlier operations?
+ */
+Session::Session(Connection *connection, bool causal) :
+    _connection(connection),
+    _causal(causal)
+{
+    // generator for the session ids, every loop thread has its own
+    static thread_local std::mt19937_64 generator(std::random_device{}());
+
+    // fill a random uuid
+    unsigned char uuid[16];
+    uint64_t high = generator(), low = generator();
+    memcpy(uuid, &high, 8);
+    memcpy(uuid + 8, &low, 8);
+
+    // mark it as a version 4 uuid
+    uuid[6] = (uuid[6] & 0x0f) | 0x40;
+    uuid[8] = (uuid[8] & 0x3f) | 0x80;
+
+    // the session id is a document holding the uuid
+    mongo::BSONObjBuilder builder;
+    builder.appendBinData("id", sizeof(uuid), mongo::newUUID, uuid);
+    _id = builder.obj();
+}
+
+/**
+ *  The database part of a namespace
+ *
+ *  @param  collection  database name and collection
+ */
+std::string Session::database(const std::string& collection)
+{
+    // the database ends at the first dot
+    return collection.substr(0, collection.find('.'));
+}
+
+/**
+ *  The collection part of a namespace
+ *
+ *  @param  collection  database name and collection
+ */
+std::string Session::collection(const std::string& collection)
+{
+    // the collection starts after the first dot
+    return collection.substr(collection.find('.') + 1);
+}
+
+/**
+ *  Add the session fields to a command and run it
+ *
+ *  @param  database    the database to run the command on
+ *  @param  command     the command, without the session fields
+ *  @param  read        is this the first command of a read?
+ *  @return mongo::BSONObj  the reply
+ */
+mongo::BSONObj Session::run(const std::string& database, mongo::BSONObjBuilder& command, bool read)
+{
+    // the session the command belongs to
+    command.append("lsid", _id);
+
+    // commands in a transaction carry its number
+    if (_active)
+    {
+        // add the transaction number
+        command.append("txnNumber", _number);
+
+        // the first command starts the transaction, and decides what it reads
+        if (!_started)
+        {
+            command.append("startTransaction", true);
+            if (_causal && !_readConcern.isEmpty()) command.append("readConcern", _readConcern);
+        }
+
+        // transactions are committed explicitly
+        command.append("autocommit", false);
+
+        // the transaction now exists on the server
+        _started = true;
+    }
+    else if (read && _causal && !_readConcern.isEmpty())
+    {
+        // reads must see what the session did before
+        command.append("readConcern", _readConcern);
+    }
+
+    // pass on the cluster time we know of
+    if (!_clusterTime.isEmpty()) command.append("$clusterTime", _clusterTime);
+
+    // run the command
+    mongo::BSONObj reply;
+    bool success = _connection->_mongo.runCommand(database, command.obj(), reply);
+
+    // remember the operation time, the next reads must not see anything older
+    auto time = reply.getField("operationTime");
+    if (time.type() == mongo::Timestamp)
+    {
+        mongo::BSONObjBuilder concern;
+        concern.appendAs(time, "afterClusterTime");
+        _readConcern = concern.obj();
+    }
+
+    // remember the cluster time
+    auto cluster = reply.getField("$clusterTime");
+    if (cluster.type() == mongo::Object) _clusterTime = cluster.Obj().getOwned();
+
+    // did the command fail?
+    if (!success) throw mongo::UserException(reply.getIntField("code"), reply.getStringField("errmsg"));
+
+    // the command succeeds even if its writes failed
+    auto errors = reply.getField("writeErrors");
+    if (errors.type() == mongo::Array && !errors.Obj().isEmpty())
+    {
+        // report the first error
+        auto error = errors.Obj().firstElement().Obj();
+        throw mongo::UserException(error.getIntField("code"), error.getStringField("errmsg"));
+    }
+
+    // or if the write concern could not be satisfied
+    auto concern = reply.getField("writeConcernError");
+    if (concern.type() == mongo::Object) throw mongo::UserException(concern.Obj().getIntField("code"), concern.Obj().getStringField("errmsg"));
+
+    // return the reply
+    return reply;
+}
+
+/**
+ *  Send all writes of the transaction that were not yet sent
+ */
+void Session::flush()
+{
+    // process the writes in groups
+    for (size_t first = 0; first < _writes.size(); )
+    {
+        // the first write of the group
+        auto &write = _writes[first];
+
+        // the group ends at the first write of another kind or on another collection
+        size_t last = first + 1;
+        while (last < _writes.size() && _writes[last].collection == write.collection && strcmp(_writes[last].command, write.command) == 0) ++last;
+
+        // build the command holding all writes in the group
+        mongo::BSONObjBuilder command;
+        command.append(write.command, collection(write.collection));
+        mongo::BSONArrayBuilder operations(command.subarrayStart(write.list));
+        for (size_t i = first; i < last; ++i) operations.append(_writes[i].operation);
+        operations.done();
+
+        try
+        {
+            // a failed transaction is not continued
+            if (_active && !_error.empty()) throw mongo::UserException(0, _error);
+
+            // send the writes
+            run(database(write.collection), command, false);
+
+            // report the success
+            for (size_t i = first; i < last; ++i)
+            {
+                auto deferred = _writes[i].deferred;
+                _connection->_master.execute([deferred]() { deferred->success(); });
+            }
+        }
+        catch (mongo::DBException& exception)
+        {
+            // the first failure aborts the transaction
+            if (_active && _error.empty()) _error = exception.toString();
+
+            // report the failure
+            for (size_t i = first; i < last; ++i)
+            {
+                auto deferred = _writes[i].deferred;
+                _connection->_master.execute([deferred, exception]() { deferred->failure(exception.toString().c_str()); });
+            }
+        }
+
+        // continue with the next group
+        first = last;
+    }
+
+    // all writes were sent
+    _writes.clear();
+}
+
+/**
+ *  Run a write, or add it to the transaction when one is open
+ *
+ *  @param  collection  database name and collection
+ *  @param  command     the write command, like "insert"
+ *  @param  list        the name of its list of operations, like "documents"
+ *  @param  operation   function that encodes the operation in the worker
+ *  @return the deferred handler
+ */
+Deferred<>& Session::write(const std::string& collection, const char *command, const char *list, std::function<mongo::BSONObj()>&& operation)
+{
+    // create the deferred handler
+    auto deferred = std::make_shared<Deferred<>>();
+
+    // the collected updates of the collection must be applied first
+    if (_connection->_writeBehind.pending(collection)) _connection->flush();
+
+    // check whether we are within the limits
+    if (!_connection->_throttle.acquire(1)) return _connection->reject(deferred);
+
+    // run the write in the worker
+    _connection->execute(1, [this, collection, command, list, operation, deferred]() {
+        try
+        {
+            // encode the write and add it to the ones waiting to be sent
+            _writes.push_back(Write{ collection, command, list, operation(), deferred });
+
+            // outside a transaction it is sent right away
+            if (!_active) flush();
+        }
+        catch (mongo::DBException& exception)
+        {
+            // inform the listener of the specific failure
+            _connection->_master.execute([deferred, exception]() { deferred->failure(exception.toString().c_str()); });
+        }
+    });
+
+    // return the deferred handler
+    return *deferred;
+}
+
+/**
+ *  Start a transaction
+ *
+ *  @return the same session
+ */
+Session& Session::startTransaction()
+{
+    // nothing to do if one is open already
+    if (_transaction) return *this;
+
+    // the next operations are part of the transaction
+    _transaction = true;
+
+    // the worker starts a new transaction, it is sent along with the first operation
+    _connection->_worker.execute([this]() {
+        _active = true;
+        _started = false;
+        _error.clear();
+        _number += 1;
+    });
+
+    // allow chaining
+    return *this;
+}
+
+/**
+ *  Commit the transaction
+ *
+ *  @param  concern     the write concern to wait for
+ *  @return the deferred handler
+ */
+DeferredCommit& Session::commit(const WriteConcern& concern)
+{
+    // create the deferred handler
+    auto deferred = std::make_shared<DeferredCommit>();
+
+    // there must be a transaction
+    if (!_transaction)
+    {
+        // report the failure from the event loop
+        _connection->_master.execute([deferred]() { deferred->failure("No transaction in progress"); });
+        return *deferred;
+    }
+
+    // the transaction is over for the caller
+    _transaction = false;
+
+    // the commit is never throttled, or the transaction would stay open
+    _connection->_worker.execute([this, concern, deferred]() {
+        try
+        {
+            // send the writes that are still waiting
+            flush();
+
+            // a failed write aborted the transaction
+            if (!_error.empty()) throw mongo::UserException(0, _error);
+
+            // commit, unless nothing was sent at all
+            if (_started)
+            {
+                // the command to commit
+                mongo::BSONObjBuilder command;
+                command.append("commitTransaction", 1);
+
+                // add the write concern, if one was given
+                if (concern.w > 0 || concern.journal || concern.timeout > 0)
+                {
+                    mongo::BSONObjBuilder writeConcern(command.subobjStart("writeConcern"));
+                    if (concern.w > 0) writeConcern.append("w", concern.w);
+                    if (concern.journal) writeConcern.append("j", true);
+                    if (concern.timeout > 0) writeConcern.append("wtimeout", concern.timeout);
+                    writeConcern.done();
+                }
+
+                // run the command
+                run("admin", command, false);
+            }
+
+            // report the success
+            _connection->_master.execute([deferred]() { deferred->success(); });
+        }
+        catch (mongo::DBException& exception)
+        {
+            // release the transaction on the server, if a write failed
+            if (_started && !_error.empty())
+            {
+                mongo::BSONObjBuilder command;
+                command.append("abortTransaction", 1);
+                try { run("admin", command, false); } catch (const mongo::DBException&) {}
+            }
+
+            // inform the listener of the specific failure
+            _connection->_master.execute([deferred, exception]() { deferred->failure(exception.toString().c_str()); });
+        }
+
+        // the transaction is over
+        _active = false;
+    });
+
+    // return the deferred handler
+    return *deferred;
+}
+
+/**
+ *  Abort the transaction
+ *
+ *  @return the deferred handler
+ */
+DeferredAbort& Session::abort()
+{
+    // create the deferred handler
+    auto deferred = std::make_shared<DeferredAbort>();
+
+    // there must be a transaction
+    if (!_transaction)
+    {
+        // report the failure from the event loop
+        _connection->_master.execute([deferred]() { deferred->failure("No transaction in progress"); });
+        return *deferred;
+    }
+
+    // the transaction is over for the caller
+    _transaction = false;
+
+    // the abort is never throttled, or the transaction would stay open
+    _connection->_worker.execute([this, deferred]() {
+        // drop the writes that were not sent
+        _writes.clear();
+
+        try
+        {
+            // abort on the server, if anything was sent
+            if (_started)
+            {
+                mongo::BSONObjBuilder command;
+                command.append("abortTransaction", 1);
+                run("admin", command, false);
+            }
+
+            // report the success
+            _connection->_master.execute([deferred]() { deferred->success(); });
+        }
+        catch (mongo::DBException& exception)
+        {
+            // inform the listener of the specific failure
+            _connection->_master.execute([deferred, exception]() { deferred->failure(exception.toString().c_str()); });
+        }
+
+        // the transaction is over
+        _active = false;
+    });
+
+    // return the deferred handler
+    return *deferred;
+}
+
+/**
+ *  Query a collection
+ *
+ *  @param  collection  database name and collection
+ *  @param  query       the query to execute
+ */
+DeferredQuery& Session::query(const std::string& collection, Variant::Value&& query)
+{
+    // move the query to a pointer to avoid needless copying
+    auto request = std::make_shared<Variant::Value>(std::move(query));
+
+    // create the deferred handler
+    auto deferred = std::make_shared<DeferredQuery>();
+
+    // the collected updates of the collection must be applied first
+    if (_connection->_writeBehind.pending(collection)) _connection->flush();
+
+    // check whether we are within the limits
+    if (!_connection->_throttle.acquire(1)) return _connection->reject(deferred);
+
+    // run the query in the worker
+    _connection->execute(1, [this, collection, request, deferred]() {
+        try
+        {
+            // the query must see the writes of the transaction
+            flush();
+
+            // a failed write aborted the transaction
+            if (_active && !_error.empty()) throw mongo::UserException(0, _error);
+
+            // the command to start the query
+            mongo::BSONObjBuilder command;
+            command.append("find", Session::collection(collection));
+            command.append("filter", _connection->convert(*request));
+
+            // run it
+            auto reply = run(database(collection), command, true);
+
+            // the cursor and the documents it returned
+            auto cursor = reply.getObjectField("cursor");
+            auto batch = cursor.getObjectField("firstBatch");
+
+            // build the result value
+            auto result = std::make_shared<std::vector<Variant::Value>>();
+
+            // process all batches
+            while (true)
+            {
+                // convert the documents
+                for (auto iter = batch.begin(); iter.more(); ) result->push_back(_connection->convert(_connection->check(iter.next().Obj())));
+
+                // stop when the cursor is exhausted
+                long long id = cursor.getField("id").numberLong();
+                if (id == 0) break;
+
+                // ask for the next batch
+                mongo::BSONObjBuilder more;
+                more.append("getMore", id);
+                more.append("collection", Session::collection(collection));
+                reply = run(database(collection), more, false);
+
+                // the documents in it
+                cursor = reply.getObjectField("cursor");
+                batch = cursor.getObjectField("nextBatch");
+            }
+
+            // we now have all results, execute callback in master thread
+            _connection->_master.execute([result, deferred]() { deferred->success(std::move(*result)); });
+        }
+        catch (mongo::DBException& exception)
+        {
+            // something went awry, notify listener
+            _connection->_master.execute([deferred, exception]() { deferred->failure(exception.toString().c_str()); });
+        }
+    });
+
+    // return the deferred handler
+    return *deferred;
+}
+
+/**
+ *  Query a collection
+ *
+ *  @param  collection  database name and collection
+ *  @param  query       the query to execute
+ */
+DeferredQuery& Session::query(const std::string& collection, const Variant::Value& query)
+{
+    // move a copy to the implementation
+    return this->query(collection, Variant::Value(query));
+}
+
+/**
+ *  Insert a document into a collection
+ *
+ *  @param  collection  database name and collection
+ *  @param  document    document to insert
+ */
+DeferredInsert& Session::insert(const std::string& collection, Variant::Value&& document)
+{
+    // move the document to a pointer to avoid needless copying
+    auto insert = std::make_shared<Variant::Value>(std::move(document));
+
+    // the document is the operation
+    return write(collection, "insert", "documents", [this, insert]() {
+        return _connection->check(_connection->convert(*insert));
+    });
+}
+
+/**
+ *  Insert a document into a collection
+ *
+ *  @param  collection  database name and collection
+ *  @param  document    document to insert
+ */
+DeferredInsert& Session::insert(const std::string& collection, const Variant::Value& document)
+{
+    // move a copy to the implementation
+    return insert(collection, Variant::Value(document));
+}
+
+/**
+ *  Update an existing document in a collection
+ *
+ *  @param  collection  collection keeping the document to be updated
+ *  @param  query       the query to find the document(s) to update
+ *  @param  document    the new document to replace existing document with
+ *  @param  upsert      if no matching document was found, create one instead
+ *  @param  multi       if multiple matching documents are found, update them all
+ */
+DeferredUpdate& Session::update(const std::string& collection, Variant::Value&& query, Variant::Value&& document, bool upsert, bool multi)
+{
+    // move the query and document to a pointer to avoid needless copying
+    auto request = std::make_shared<Variant::Value>(std::move(query));
+    auto update = std::make_shared<Variant::Value>(std::move(document));
+
+    // the update statement is the operation
+    return write(collection, "update", "updates", [this, request, update, upsert, multi]() {
+        return BSON("q" << _connection->convert(*request) << "u" << _connection->check(_connection->convert(*update)) << "upsert" << upsert << "multi" << multi);
+    });
+}
+
+/**
+ *  Update an existing document in a collection
+ *
+ *  @param  collection  collection keeping the document to be updated
+ *  @param  query       the query to find the document(s) to update
+ *  @param  document    the new document to replace existing document with
+ *  @param  upsert      if no matching document was found, create one instead
+ *  @param  multi       if multiple matching documents are found, update them all
+ */
+DeferredUpdate& Session::update(const std::string& collection, const Variant::Value& query, const Variant::Value& document, bool upsert, bool multi)
+{
+    // move a copy to the implementation
+    return update(collection, Variant::Value(query), Variant::Value(document), upsert, multi);
+}
+
+/**
+ *  Remove one or more existing documents from a collection
+ *
+ *  @param  collection  collection holding the document(s) to be removed
+ *  @param  query       the query to find the document(s) to remove
+ *  @param  limitToOne  limit the removal to a single document
+ */
+DeferredRemove& Session::remove(const std::string& collection, Variant::Value&& query, bool limitToOne)
+{
+    // move the query to a pointer to avoid needless copying
+    auto request = std::make_shared<Variant::Value>(std::move(query));
+
+    // the delete statement is the operation
+    return write(collection, "delete", "deletes", [this, request, limitToOne]() {
+        return BSON("q" << _connection->convert(*request) << "limit" << (limitToOne ? 1 : 0));
+    });
+}
+
+/**
+ *  Remove one or more existing documents from a collection
+ *
+ *  @param  collection  collection holding the document(s) to be removed
+ *  @param  query       the query to find the document(s) to remove
+ *  @param  limitToOne  limit the removal to a single document
+ */
+DeferredRemove& Session::remove(const std::string& collection, const Variant::Value& query, bool limitToOne)
+{
+    // move a copy to the implementation
+    return remove(collection, Variant::Value(query), limitToOne);
+}
+
+/**
+ *  End the session
+ */
+void Session::end()
+{
+    // an open transaction is aborted
+    if (_transaction) abort();
+
+    // tell the server the session is no longer used, after all other operations
+    _connection->_worker.execute([this]() {
+        try
+        {
+            // the command to end the session
+            mongo::BSONObjBuilder command;
+            mongo::BSONArrayBuilder sessions(command.subarrayStart("endSessions"));
+            sessions.append(_id);
+            sessions.done();
+
+            // the server cleans up unused sessions anyway, so the result does not matter
+            mongo::BSONObj reply;
+            _connection->_mongo.runCommand("admin", command.obj(), reply);
+        }
+        catch (const mongo::DBException&) {}
+
+        // the connection destroys us on the event loop
+        auto connection = _connection;
+        connection->_master.execute([connection, this]() { connection->endSession(this); });
+    });
+}
+
+/**
+ *  End namespace
+ */
+}}
@@ -0,0 +1,320 @@
+/**
+ *  Subscription.cpp
+ *
+ *  A subscription on a tailable cursor or on a change stream.
+ *  New documents or change events are pushed to the callback
+ *  on the event loop as soon as they become available.
+ *
+ *  @copyright 2014 Copernica BV
+ */
+
+#include "includes.h"
+
+/**
+ *  Set up namespace
+ */
+namespace React { namespace Mongo {
+
+/**
+ *  Constructor
+ *
+ *  @param  connection  the connection we belong to
+ *  @param  collection  database name and collection
+ *  @param  query       the query to tail, or the pipeline to watch
+ *  @param  watch       watch a change stream instead of tailing a cursor
+ *  @param  token       resume token to continue from (change streams only)
+ */
+Subscription::Subscription(Connection *connection, const std::string& collection, mongo::BSONObj&& query, bool watch, mongo::BSONObj&& token) :
+    _connection(connection),
+    _mongo(true),
+    _collection(collection),
+    _query(std::move(query)),
+    _watch(watch),
+    _position(std::move(token)),
+    _token(_position),
+    _cancelled(std::make_shared<std::atomic<bool>>(false)),
+    _worker()
+{
+    // connect to mongo and start waiting for data
+    _worker.execute([this]() { run(); });
+}
+
+/**
+ *  Destructor
+ */
+Subscription::~Subscription()
+{
+    // make sure the worker stops, the worker is destroyed first,
+    // which waits for the run it may be busy with
+    *_cancelled = true;
+}
+
+/**
+ *  The database part of the namespace
+ *
+ *  @return std::string
+ */
+std::string Subscription::database() const
+{
+    // everything up to the first dot
+    return _collection.substr(0, _collection.find('.'));
+}
+
+/**
+ *  The collection part of the namespace
+ *
+ *  @return std::string
+ */
+std::string Subscription::collection() const
+{
+    // everything after the first dot
+    return _collection.substr(_collection.find('.') + 1);
+}
+
+/**
+ *  Retrieve the next batch from the tailable cursor
+ *
+ *  @param  documents   vector to add the documents to
+ */
+void Subscription::tail(std::vector<mongo::BSONObj>& documents)
+{
+    // do we have to open the cursor?
+    if (!_cursor)
+    {
+        // the query to run
+        mongo::BSONObj query = _query;
+
+        // if we already received documents we continue after the last one,
+        // this assumes that the _id values increase in insertion order
+        if (!_position.isEmpty())
+        {
+            // continue after the last document
+            mongo::BSONObjBuilder condition;
+            condition.appendAs(_position.firstElement(), "$gt");
+
+            // in addition to the conditions of the query
+            mongo::BSONArrayBuilder conditions;
+            conditions.append(_query);
+            conditions.append(BSON("_id" << condition.obj()));
+
+            // this is the query to run
+            query = BSON("$and" << conditions.arr());
+        }
+
+        // open the cursor, waiting for data on the server
+        _cursor.reset(_mongo.query(_collection, query, 0, 0, nullptr, mongo::QueryOption_CursorTailable | mongo::QueryOption_AwaitData).release());
+
+        // the driver returns nothing on connection failures
+        if (!_cursor) throw mongo::UserException(0, "Unspecified connection error");
+    }
+
+    // wait for data, this returns when the server gives up waiting
+    if (_cursor->more())
+    {
+        // take the whole batch
+        do
+        {
+            // retrieve the document, it must outlive the cursor
+            auto document = _cursor->next().getOwned();
+
+            // this is the position to continue from
+            _position = document["_id"].wrap();
+
+            // add the document
+            documents.push_back(std::move(document));
+        }
+        while (_cursor->moreInCurrentBatch());
+    }
+
+    // is the cursor still alive?
+    if (!_cursor->isDead()) return;
+
+    // the cursor dies when the collection is empty, it will be reopened
+    _cursor.reset();
+
+    // don't hammer the server while we wait for the first document
+    if (documents.empty()) std::this_thread::sleep_for(std::chrono::milliseconds(100));
+}
+
+/**
+ *  Retrieve the next batch from the change stream
+ *
+ *  @param  documents   vector to add the change events to
+ */
+void Subscription::watch(std::vector<mongo::BSONObj>& documents)
+{
+    // the command to run and the result
+    mongo::BSONObj command, result;
+
+    // do we have to open the change stream?
+    if (_cursorId == 0)
+    {
+        // the options for the change stream
+        mongo::BSONObjBuilder options;
+
+        // continue from the last position if we have one
+        if (!_position.isEmpty()) options.append("resumeAfter", _position);
+
+        // the pipeline starts with the change stream itself
+        mongo::BSONArrayBuilder pipeline;
+        pipeline.append(BSON("$changeStream" << options.obj()));
+
+        // followed by the stages given by the user
+        for (auto iter = _query.begin(); iter.more(); ) pipeline.append(iter.next());
+
+        // open the change stream
+        command = BSON("aggregate" << collection() << "pipeline" << pipeline.arr() << "cursor" << mongo::BSONObj());
+    }
+    else
+    {
+        // get the next batch, waiting on the server for at most a second
+        command = BSON("getMore" << _cursorId << "collection" << collection() << "maxTimeMS" << 1000);
+    }
+
+    // run the command
+    _mongo.runCommand(database(), command, result);
+
+    // did the command fail?
+    if (!result["ok"].trueValue())
+    {
+        // the cursor is no longer usable
+        _cursorId = 0;
+
+        // report the error
+        throw mongo::UserException(result["code"].numberInt(), result["errmsg"].str());
+    }
+
+    // the cursor with the batch
+    auto cursor = result["cursor"].Obj();
+
+    // store the cursor id, when it is zero the stream will be reopened
+    _cursorId = cursor["id"].numberLong();
+
+    // the batch is named differently for the first and subsequent batches
+    auto batch = cursor.hasField("firstBatch") ? cursor["firstBatch"].Obj() : cursor["nextBatch"].Obj();
+
+    // process the batch
+    for (auto iter = batch.begin(); iter.more(); )
+    {
+        // retrieve the event, it must outlive the result
+        auto event = iter.next().Obj().getOwned();
+
+        // the _id of the event is its resume token
+        _position = event["_id"].Obj().getOwned();
+
+        // add the event
+        documents.push_back(std::move(event));
+    }
+
+    // newer servers tell us where to continue even if the batch was empty
+    if (cursor.hasField("postBatchResumeToken")) _position = cursor["postBatchResumeToken"].Obj().getOwned();
+}
+
+/**
+ *  Kill the cursor on the server, it is reopened on the next run
+ */
+void Subscription::close()
+{
+    try
+    {
+        // kill the tailable cursor, the driver should not do it again
+        if (_cursor && _cursor->getCursorId() != 0) { _mongo.killCursor(_cursor->getCursorId()); _cursor->decouple(); }
+
+        // and the cursor of the change stream
+        if (_cursorId != 0) _mongo.killCursor(_cursorId);
+    }
+    catch (const mongo::DBException&)
+    {
+        // the server cleans up the cursor when it times out
+    }
+
+    // the cursors are gone
+    _cursor.reset();
+    _cursorId = 0;
+}
+
+/**
+ *  Wait for the next batch and schedule the next run,
+ *  this is executed in our own worker thread.
+ */
+void Subscription::run()
+{
+    // the connection, and the flag shared with the callbacks
+    auto connection = _connection;
+    auto cancelled = _cancelled;
+
+    // are we cancelled?
+    if (*cancelled)
+    {
+        // free the cursor on the server
+        close();
+
+        // let the connection clean us up, the worker has nothing left to do,
+        // the pointer is only used to find us, we may be destroyed already
+        connection->_master.execute([connection, this]() { connection->unsubscribe(this); });
+        return;
+    }
+
+    try
+    {
+        // the documents we receive in this batch
+        std::vector<mongo::BSONObj> documents;
+
+        // do we still have to connect?
+        if (!_connected)
+        {
+            // connect throws an exception on failure
+            Resolver::connect(_mongo, _connection->_host);
+
+            // we are connected
+            _connected = true;
+        }
+
+        // wait for the next batch
+        if (_watch) watch(documents);
+        else tail(documents);
+
+        // did we receive anything that we still have to report?
+        if (!documents.empty() && !*cancelled)
+        {
+            // convert the documents
+            auto results = std::make_shared<std::vector<Variant::Value>>();
+            results->reserve(documents.size());
+            for (auto &document : documents) results->push_back(connection->convert(document));
+
+            // the position to report
+            auto position = _position;
+
+            // and report them on the event loop
+            connection->_master.execute([this, cancelled, results, position]() {
+                // we may have been cancelled or destroyed in the meantime
+                if (*cancelled) return;
+
+                // we have now delivered up to here
+                _token = position;
+
+                // pass all documents to the callback, unless we're cancelled
+                for (auto &result : *results) if (!*cancelled && _dataCallback) _dataCallback(std::move(result));
+            });
+        }
+    }
+    catch (const mongo::DBException& exception)
+    {
+        // reopen from the last position on the next run
+        close();
+
+        // inform the listener of the failure, unless we're cancelled
+        if (!*cancelled) connection->_master.execute([this, cancelled, exception]() { if (!*cancelled && _failureCallback) _failureCallback(exception.toString().c_str()); });
+
+        // wait a little before we try again
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+
+    // continue waiting
+    _worker.execute([this]() { run(); });
+}
+
+/**
+ *  End namespace
+ */
+}}
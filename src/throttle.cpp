@@ -0,0 +1,114 @@
+/**
+ *  Throttle.cpp
+ *
+ *  Class limiting the number of operations and documents
+ *  that are queued for or in progress in the worker.
+ *
+ *  @copyright 2014 Copernica BV
+ */
+
+#include "includes.h"
+
+/**
+ *  Set up namespace
+ */
+namespace React { namespace Mongo {
+
+/**
+ *  Set the limits
+ *
+ *  @param  operations  maximum number of pending operations, zero for no limit
+ *  @param  documents   maximum number of pending documents, zero for no limit
+ *  @param  policy      what to do when the limits are reached
+ */
+void Throttle::set(size_t operations, size_t documents, Overload policy)
+{
+    // lock the counters
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // store the settings
+    _operations = operations;
+    _documents = documents;
+    _policy = policy;
+
+    // blocked callers may fit within the new limits
+    _condition.notify_all();
+}
+
+/**
+ *  Add an operation, this is called from the event loop
+ *
+ *  @param  documents   number of documents in the operation
+ *  @return bool        false if the operation must be rejected
+ */
+bool Throttle::acquire(size_t documents)
+{
+    // lock the counters
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    // do we exceed the limits?
+    if (exceeds(documents))
+    {
+        // check what we should do about it
+        switch (_policy)
+        {
+            case Overload::Fail:
+                // reject the operation
+                return false;
+
+            case Overload::Block:
+                // wait until the worker finished enough operations
+                _condition.wait(lock, [this, documents]() { return !exceeds(documents); });
+                break;
+
+            case Overload::Notify:
+                // report the overload, but only once
+                if (!_overloaded && _overloadCallback) _master.execute([this]() { if (_overloadCallback) _overloadCallback(); });
+                _overloaded = true;
+                break;
+        }
+    }
+
+    // add the operation
+    _pendingOperations += 1;
+    _pendingDocuments += documents;
+
+    // accepted
+    return true;
+}
+
+/**
+ *  Remove a finished operation, this is called from the worker
+ *
+ *  @param  documents   number of documents in the operation
+ */
+void Throttle::release(size_t documents)
+{
+    // lock the counters
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // remove the operation
+    _pendingOperations -= 1;
+    _pendingDocuments -= documents;
+
+    // wake up blocked callers
+    _condition.notify_all();
+
+    // nothing to report if we were not overloaded
+    if (!_overloaded) return;
+
+    // we report the drain when we're below half the limits
+    if (_operations > 0 && _pendingOperations > _operations / 2) return;
+    if (_documents > 0 && _pendingDocuments > _documents / 2) return;
+
+    // the overload is over
+    _overloaded = false;
+
+    // report it on the event loop
+    _master.execute([this]() { if (_drainedCallback) _drainedCallback(); });
+}
+
+/**
+ *  End namespace
+ */
+}}
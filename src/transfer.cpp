@@ -0,0 +1,522 @@
+/**
+ *  Transfer.cpp
+ *
+ *  Class to copy whole collections, to another server or to a file,
+ *  and to load them from a file again.
+ *
+ *  @copyright 2014 Copernica BV
+ */
+
+#include "includes.h"
+
+/**
+ *  Set up namespace
+ */
+namespace React { namespace Mongo {
+
+/**
+ *  Size of the blocks read from files
+ */
+static const size_t blockSize = 1024 * 1024;
+
+/**
+ *  Read a 32-bit number in little endian byte order
+ *
+ *  @param  data        the data to read from
+ *  @return int32_t
+ */
+static int32_t load(const char *data)
+{
+    // the bytes as unsigned values
+    auto bytes = reinterpret_cast<const unsigned char *>(data);
+
+    // combine the bytes
+    return (int32_t)((uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24));
+}
+
+/**
+ *  Constructor
+ *
+ *  @param  connection  the connection to the server
+ *  @param  channels    number of parallel channels
+ *  @param  batch       maximum number of documents written at once
+ */
+Transfer::Transfer(Connection *connection, size_t channels, size_t batch) :
+    _connection(connection),
+    _batch(std::max<size_t>(batch, 1))
+{
+    // create all channels
+    for (size_t i = 0; i < std::max<size_t>(channels, 1); ++i)
+    {
+        // create the channel
+        auto channel = new Channel();
+
+        // store it
+        _channels.emplace_back(channel);
+
+        // connect to mongo, failures are reported by the operations
+        // themselves, as the connection automatically reconnects
+        channel->worker.execute([this, channel]() {
+            try
+            {
+                // connect throws an exception on failure
+                Resolver::connect(channel->mongo, _connection->_host);
+            }
+            catch (const mongo::DBException&) {}
+        });
+    }
+}
+
+/**
+ *  Divide a collection in ranges of _id values of about the same size
+ *
+ *  @param  channel     the channel to use
+ *  @param  collection  database name and collection
+ *  @return std::vector the boundaries between the ranges
+ */
+std::vector<mongo::BSONObj> Transfer::split(Channel *channel, const std::string& collection)
+{
+    // the boundaries
+    std::vector<mongo::BSONObj> result;
+
+    // with a single channel there is just one range
+    if (_channels.size() < 2) return result;
+
+    // we take a sample of the ids, more samples than ranges make the ranges more even
+    int samples = _channels.size() * 32;
+
+    // the database and the collection are separated by the first dot
+    auto dot = collection.find('.');
+
+    // the command to take the sample, sorted by id
+    auto pipeline = BSON_ARRAY(BSON("$sample" << BSON("size" << samples)) << BSON("$project" << BSON("_id" << 1)) << BSON("$sort" << BSON("_id" << 1)));
+    auto command = BSON("aggregate" << collection.substr(dot + 1) << "pipeline" << pipeline << "cursor" << BSON("batchSize" << samples));
+
+    // servers that cannot take samples read everything as a single range
+    mongo::BSONObj reply;
+    if (!channel->mongo.runCommand(collection.substr(0, dot), command, reply)) return result;
+
+    // the sampled ids
+    std::vector<mongo::BSONObj> ids;
+    auto batch = reply.getObjectField("cursor").getObjectField("firstBatch");
+    for (auto iter = batch.begin(); iter.more(); ) ids.push_back(iter.next().Obj().getOwned());
+
+    // an empty collection is a single range
+    if (ids.empty()) return result;
+
+    // pick evenly spaced ids as boundaries
+    for (size_t i = 1; i < _channels.size(); ++i)
+    {
+        // the id at this position
+        auto &id = ids[ids.size() * i / _channels.size()];
+
+        // small collections may give the same boundary twice
+        if (!result.empty() && result.back().woCompare(id) == 0) continue;
+
+        // add the boundary
+        result.push_back(id);
+    }
+
+    // done
+    return result;
+}
+
+/**
+ *  Mark a job of a transfer as finished, and report the
+ *  result when it was the last one
+ *
+ *  @param  progress    the state of the transfer
+ *  @param  deferred    the deferred to report to
+ */
+void Transfer::finish(const std::shared_ptr<Progress>& progress, const std::shared_ptr<DeferredTransfer>& deferred)
+{
+    // are there other jobs still running?
+    if (--progress->pending > 0) return;
+
+    // this was the last job, report the result
+    if (progress->error.empty()) _connection->_master.execute([deferred, progress]() { deferred->success(progress->documents); });
+    else _connection->_master.execute([deferred, progress]() { deferred->failure(progress->error.c_str()); });
+}
+
+/**
+ *  Read a whole collection over all channels, and pass the documents on
+ *
+ *  @param  collection  database name and collection
+ *  @param  sink        function that passes on a batch of documents
+ *  @return the deferred handler
+ */
+DeferredTransfer& Transfer::read(const std::string& collection, const Sink& sink)
+{
+    // create the deferred handler
+    auto deferred = std::make_shared<DeferredTransfer>();
+
+    // the first channel divides the collection
+    auto channel = _channels.front().get();
+
+    // run the transfer in the worker
+    channel->worker.execute([this, channel, collection, sink, deferred]() {
+        try
+        {
+            // the boundaries between the ranges
+            auto boundaries = split(channel, collection);
+
+            // every range is read by its own channel
+            auto progress = std::make_shared<Progress>();
+            progress->pending = boundaries.size() + 1;
+
+            // start reading all ranges
+            for (size_t i = 0; i <= boundaries.size(); ++i)
+            {
+                // the range, the first and last ones are open ended
+                auto min = i == 0 ? mongo::BSONObj() : boundaries[i - 1];
+                auto max = i == boundaries.size() ? mongo::BSONObj() : boundaries[i];
+
+                // the channel to use
+                auto reader = _channels[i].get();
+
+                // read the range
+                reader->worker.execute([this, reader, collection, min, max, sink, progress, deferred]() {
+                    try
+                    {
+                        // the range is taken from the _id index, which also
+                        // works when the ids are of different types
+                        mongo::Query query;
+                        query.hint(BSON("_id" << 1));
+                        if (!min.isEmpty()) query.minKey(min);
+                        if (!max.isEmpty()) query.maxKey(max);
+
+                        // retrieve the documents
+                        auto cursor = reader->mongo.query(collection, query);
+
+                        // the driver returns nothing on connection failures
+                        if (cursor.get() == NULL) throw mongo::UserException(0, "Unspecified connection error");
+
+                        // the documents to pass on
+                        std::vector<mongo::BSONObj> documents;
+                        documents.reserve(_batch);
+
+                        // process all documents
+                        while (cursor->more())
+                        {
+                            // add the next document
+                            documents.push_back(cursor->next());
+
+                            // the documents point into the batch received from the server,
+                            // so they are passed on before the next batch is requested
+                            if (documents.size() < _batch && cursor->moreInCurrentBatch()) continue;
+
+                            // pass them on
+                            sink(reader, documents, *progress);
+                            progress->documents += documents.size();
+                            documents.clear();
+                        }
+                    }
+                    catch (const mongo::DBException& exception)
+                    {
+                        // remember the failure
+                        std::lock_guard<std::mutex> lock(progress->mutex);
+                        if (progress->error.empty()) progress->error = exception.toString();
+                    }
+
+                    // this range is done
+                    finish(progress, deferred);
+                });
+            }
+        }
+        catch (const mongo::DBException& exception)
+        {
+            // inform the listener of the failure
+            _connection->_master.execute([deferred, exception]() { deferred->failure(exception.toString().c_str()); });
+        }
+    });
+
+    // return the deferred handler
+    return *deferred;
+}
+
+/**
+ *  Copy a collection to another server
+ *
+ *  @param  source      database name and collection to copy
+ *  @param  host        the server to copy to
+ *  @param  target      database name and collection to copy to
+ */
+DeferredTransfer& Transfer::copy(const std::string& source, const std::string& host, const std::string& target)
+{
+    // read the collection, and insert the documents on the other server
+    return read(source, [host, target](Channel *channel, const std::vector<mongo::BSONObj>& documents, Progress& progress) {
+        // connect to the other server, if we did not do so already
+        if (!channel->target || channel->host != host)
+        {
+            // create the connection, it reconnects automatically
+            channel->target.reset(new mongo::DBClientConnection(true));
+            channel->host = host;
+
+            try
+            {
+                // connect throws an exception on failure
+                Resolver::connect(*channel->target, host);
+            }
+            catch (const mongo::DBException&)
+            {
+                // connect again next time
+                channel->target.reset();
+                throw;
+            }
+        }
+
+        // insert the documents, unchanged
+        channel->target->insert(target, documents);
+
+        // wait for the insert to finish, so that we do not read faster than we can write
+        auto error = channel->target->getLastError();
+        if (!error.empty()) throw mongo::UserException(0, error);
+    });
+}
+
+/**
+ *  Write a collection to a file
+ *
+ *  @param  source      database name and collection to write
+ *  @param  fd          file descriptor to write to
+ *  @param  format      the format of the file
+ */
+DeferredTransfer& Transfer::dump(const std::string& source, int fd, Format format)
+{
+    // read the collection, and write the documents to the file
+    return read(source, [fd, format](Channel *channel, const std::vector<mongo::BSONObj>& documents, Progress& progress) {
+        // every channel encodes into its own buffer
+        auto &buffer = channel->buffer;
+        buffer.clear();
+
+        // encode all documents
+        for (auto &document : documents)
+        {
+            // bson is written unchanged, json gets a line per document
+            if (format == Format::Bson) buffer.append(document.objdata(), document.objsize());
+            else buffer.append(document.jsonString()).push_back('\n');
+        }
+
+        // the channels take turns in writing to the file
+        std::lock_guard<std::mutex> lock(progress.mutex);
+
+        // write the whole buffer
+        for (size_t written = 0; written < buffer.size(); )
+        {
+            // write as much as possible
+            auto result = ::write(fd, buffer.data() + written, buffer.size() - written);
+
+            // retry when interrupted
+            if (result < 0 && errno == EINTR) continue;
+
+            // other failures are fatal
+            if (result < 0) throw mongo::UserException(errno, std::string("Failed writing data: ") + strerror(errno));
+
+            // we have written more data
+            written += result;
+        }
+    });
+}
+
+/**
+ *  Insert the documents in a file into a collection
+ *
+ *  @param  fd          file descriptor to read from
+ *  @param  target      database name and collection to insert into
+ *  @param  format      the format of the file
+ */
+DeferredTransfer& Transfer::restore(int fd, const std::string& target, Format format)
+{
+    // create the deferred handler
+    auto deferred = std::make_shared<DeferredTransfer>();
+
+    // the first channel reads the file
+    auto channel = _channels.front().get();
+
+    // run the transfer in the worker
+    channel->worker.execute([this, channel, fd, target, format, deferred]() {
+        // the state of the transfer, the reader is the first job
+        auto progress = std::make_shared<Progress>();
+        progress->pending = 1;
+
+        // the channel that inserts the next batch
+        size_t next = 0;
+
+        // function to insert a batch of documents
+        auto insert = [this, channel, target, progress, deferred, &next](std::shared_ptr<std::vector<mongo::BSONObj>>&& batch) {
+            // with a single channel the reader inserts the documents itself
+            if (_channels.size() == 1)
+            {
+                // insert the documents, and wait for it to finish
+                channel->mongo.insert(target, *batch);
+                auto error = channel->mongo.getLastError();
+                if (!error.empty()) throw mongo::UserException(0, error);
+
+                // the documents are inserted
+                progress->documents += batch->size();
+                return;
+            }
+
+            // wait until the inserting channels have room for another
+            // batch, so that we do not read faster than we can write
+            {
+                std::unique_lock<std::mutex> lock(progress->mutex);
+                progress->condition.wait(lock, [this, progress]() { return progress->batches < 2 * _channels.size(); });
+
+                // stop reading when an insert failed
+                if (!progress->error.empty()) throw mongo::UserException(0, progress->error);
+
+                // the batch is pending
+                progress->batches += 1;
+            }
+
+            // the other channels take turns in inserting the batches
+            auto writer = _channels[1 + next++ % (_channels.size() - 1)].get();
+            progress->pending += 1;
+
+            // insert the batch
+            writer->worker.execute([this, writer, target, batch, progress, deferred]() {
+                try
+                {
+                    // insert the documents, and wait for it to finish
+                    writer->mongo.insert(target, *batch);
+                    auto error = writer->mongo.getLastError();
+                    if (!error.empty()) throw mongo::UserException(0, error);
+
+                    // the documents are inserted
+                    progress->documents += batch->size();
+                }
+                catch (const mongo::DBException& exception)
+                {
+                    // remember the failure
+                    std::lock_guard<std::mutex> lock(progress->mutex);
+                    if (progress->error.empty()) progress->error = exception.toString();
+                }
+
+                // there is room for another batch
+                {
+                    std::lock_guard<std::mutex> lock(progress->mutex);
+                    progress->batches -= 1;
+                    progress->condition.notify_all();
+                }
+
+                // this batch is done
+                finish(progress, deferred);
+            });
+        };
+
+        try
+        {
+            // the data read from the file, and the position up to which it was parsed
+            std::string data;
+            size_t position = 0;
+
+            // the block to read into
+            std::unique_ptr<char[]> block(new char[blockSize]);
+
+            // the batch of documents to insert
+            auto batch = std::make_shared<std::vector<mongo::BSONObj>>();
+
+            // have we reached the end of the file?
+            bool end = false;
+
+            // process the whole file
+            while (true)
+            {
+                // parse all complete documents
+                while (position < data.size())
+                {
+                    // the parsed document
+                    mongo::BSONObj document;
+
+                    // check the format
+                    if (format == Format::Bson)
+                    {
+                        // we need the length of the document
+                        if (data.size() - position < 4) break;
+                        int32_t length = load(data.data() + position);
+
+                        // it must be a sensible length
+                        if (length < 5) throw mongo::UserException(0, "Invalid bson document");
+
+                        // the whole document must be there
+                        if (data.size() - position < (size_t)length) break;
+
+                        // copy the document, the data is reused for the next block
+                        document = mongo::BSONObj(data.data() + position).getOwned();
+                        position += length;
+                    }
+                    else
+                    {
+                        // find the end of the line
+                        auto newline = data.find('\n', position);
+                        if (newline == std::string::npos) break;
+
+                        // parse the line, skipping empty ones
+                        auto line = data.substr(position, newline - position);
+                        position = newline + 1;
+                        if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+                        document = mongo::fromjson(line);
+                    }
+
+                    // add the document to the batch
+                    batch->push_back(document);
+
+                    // is the batch full?
+                    if (batch->size() < _batch) continue;
+
+                    // insert it, and start a new one
+                    insert(std::move(batch));
+                    batch = std::make_shared<std::vector<mongo::BSONObj>>();
+                }
+
+                // stop at the end of the file
+                if (end) break;
+
+                // remove the parsed data
+                data.erase(0, position);
+                position = 0;
+
+                // read the next block
+                auto result = ::read(fd, block.get(), blockSize);
+
+                // retry when interrupted
+                if (result < 0 && errno == EINTR) continue;
+
+                // other failures are fatal
+                if (result < 0) throw mongo::UserException(errno, std::string("Failed reading data: ") + strerror(errno));
+
+                // add the data
+                data.append(block.get(), result);
+
+                // at the end of the file, the last line may not be terminated
+                if (result > 0) continue;
+                end = true;
+                if (format == Format::Json && !data.empty() && data.back() != '\n') data.push_back('\n');
+            }
+
+            // a bson file must end with a complete document
+            if (position < data.size()) throw mongo::UserException(0, "Incomplete bson document at end of file");
+
+            // insert the last batch
+            if (!batch->empty()) insert(std::move(batch));
+        }
+        catch (const mongo::DBException& exception)
+        {
+            // remember the failure
+            std::lock_guard<std::mutex> lock(progress->mutex);
+            if (progress->error.empty()) progress->error = exception.toString();
+        }
+
+        // the reader is done
+        finish(progress, deferred);
+    });
+
+    // return the deferred handler
+    return *deferred;
+}
+
+/**
+ *  End namespace
+ */
+}}
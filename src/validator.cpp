@@ -0,0 +1,366 @@
+/**
+ *  Validator.cpp
+ *
+ *  Class to check that encoded bson is well formed and that
+ *  all strings and field names in it are valid utf-8.
+ *
+ *  @copyright 2014 Copernica BV
+ */
+
+#include "includes.h"
+
+/**
+ *  Vector instructions to skip over plain ascii, the avx2 path is only
+ *  compiled in with -mavx2 (see the SIMD variable in the makefile), and
+ *  REACTCPP_MONGO_SCALAR disables both, which is used by the benchmark
+ */
+#if defined(__AVX2__) && !defined(REACTCPP_MONGO_SCALAR)
+#define VALIDATOR_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) && !defined(REACTCPP_MONGO_SCALAR)
+#define VALIDATOR_SSE2
+#include <emmintrin.h>
+#endif
+
+/**
+ *  Set up namespace
+ */
+namespace React { namespace Mongo {
+
+/**
+ *  Maximum nesting depth we accept, the server allows 100 levels
+ */
+static const int maxDepth = 100;
+
+/**
+ *  Read a 32-bit number in little endian byte order
+ *
+ *  @param  data        the data to read from
+ *  @return int32_t
+ */
+static int32_t load(const char *data)
+{
+    // the bytes as unsigned values
+    auto bytes = reinterpret_cast<const unsigned char *>(data);
+
+    // combine the bytes
+    return (int32_t)((uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24));
+}
+
+/**
+ *  Find the length of the run of ascii characters at the start of the data
+ *
+ *  @param  data        the data to check
+ *  @param  size        size of the data
+ *  @return size_t
+ */
+static size_t ascii(const unsigned char *data, size_t size)
+{
+    // the number of bytes checked
+    size_t position = 0;
+
+#if defined(VALIDATOR_AVX2) || defined(VALIDATOR_SSE2)
+    // short strings, like most field names and small values, are checked
+    // faster without loading them into vector registers
+    bool vector = size >= 32;
+#endif
+
+#if defined(VALIDATOR_AVX2)
+    // check 32 bytes at a time, a set high bit in any byte ends the run
+    for (; vector && position + 32 <= size; position += 32)
+    {
+        // load the bytes and collect their high bits
+        auto mask = _mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + position)));
+
+        // stop at the first non-ascii byte
+        if (mask != 0) return position + __builtin_ctz(mask);
+    }
+#endif
+
+#if defined(VALIDATOR_AVX2) || defined(VALIDATOR_SSE2)
+    // check 16 bytes at a time
+    for (; vector && position + 16 <= size; position += 16)
+    {
+        // load the bytes and collect their high bits
+        auto mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + position)));
+
+        // stop at the first non-ascii byte
+        if (mask != 0) return position + __builtin_ctz(mask);
+    }
+#endif
+
+    // check 8 bytes at a time, this also handles what the vector loops
+    // left over, and the strings that are too short for them
+    for (; position + 8 <= size; position += 8)
+    {
+        // load the bytes
+        uint64_t block;
+        memcpy(&block, data + position, 8);
+
+        // stop when any of them has its high bit set
+        if (block & 0x8080808080808080ULL) break;
+    }
+
+    // check the remaining bytes one at a time
+    while (position < size && data[position] < 0x80) ++position;
+
+    // this is where the run ends
+    return position;
+}
+
+/**
+ *  Check that a buffer holds valid utf-8
+ *
+ *  @param  data        the data to check
+ *  @param  size        size of the data
+ *  @return bool
+ */
+bool Validator::utf8(const char *data, size_t size)
+{
+    // we work with unsigned bytes
+    auto bytes = reinterpret_cast<const unsigned char *>(data);
+
+    // process the whole buffer
+    for (size_t position = 0; position < size; )
+    {
+        // skip over plain ascii
+        position += ascii(bytes + position, size - position);
+
+        // are we done?
+        if (position == size) return true;
+
+        // the lead byte of a multi-byte sequence
+        unsigned char lead = bytes[position];
+
+        // the number of continuation bytes, and the range of the second byte,
+        // which rules out overlong encodings, surrogates and values that are
+        // beyond the unicode range
+        size_t count;
+        unsigned char low = 0x80, high = 0xbf;
+
+        // check the lead byte
+        if      (lead >= 0xc2 && lead <= 0xdf) count = 1;
+        else if (lead == 0xe0)                 { count = 2; low = 0xa0; }
+        else if (lead == 0xed)                 { count = 2; high = 0x9f; }
+        else if (lead >= 0xe1 && lead <= 0xef) count = 2;
+        else if (lead == 0xf0)                 { count = 3; low = 0x90; }
+        else if (lead >= 0xf1 && lead <= 0xf3) count = 3;
+        else if (lead == 0xf4)                 { count = 3; high = 0x8f; }
+        else return false;
+
+        // the sequence must fit in the buffer
+        if (position + count >= size) return false;
+
+        // check the second byte against its special range
+        if (bytes[position + 1] < low || bytes[position + 1] > high) return false;
+
+        // the other bytes must be plain continuation bytes
+        for (size_t i = 2; i <= count; ++i) if ((bytes[position + i] & 0xc0) != 0x80) return false;
+
+        // move past the sequence
+        position += count + 1;
+    }
+
+    // all bytes are valid
+    return true;
+}
+
+/**
+ *  Check a nul-terminated string, such as a field name
+ *
+ *  @param  data        the string
+ *  @param  size        number of bytes available for the string
+ *  @return size_t      number of bytes used by the string, zero if invalid
+ */
+size_t Validator::cstring(const char *data, size_t size)
+{
+    // find the terminator
+    auto end = static_cast<const char *>(memchr(data, 0, size));
+
+    // it must be there
+    if (end == nullptr) return 0;
+
+    // check the contents
+    if (!utf8(data, end - data)) return 0;
+
+    // the string includes the terminator
+    return end - data + 1;
+}
+
+/**
+ *  Check a length-prefixed string value
+ *
+ *  @param  data        the encoded string
+ *  @param  size        number of bytes available for the string
+ *  @return size_t      number of bytes used by the string, zero if invalid
+ */
+size_t Validator::string(const char *data, size_t size)
+{
+    // we need the length
+    if (size < 4) return 0;
+
+    // the length includes the terminator
+    int32_t length = load(data);
+
+    // the string must fit and be terminated
+    if (length < 1 || (size_t)length > size - 4 || data[4 + length - 1] != 0) return 0;
+
+    // check the contents
+    if (!utf8(data + 4, length - 1)) return 0;
+
+    // the number of bytes used
+    return 4 + length;
+}
+
+/**
+ *  Check a document, and all documents nested in it
+ *
+ *  @param  data        the encoded document
+ *  @param  size        number of bytes available for the document
+ *  @param  depth       the nesting depth of the document
+ *  @return bool
+ */
+bool Validator::document(const char *data, size_t size, int depth)
+{
+    // check the nesting
+    if (depth > maxDepth) return false;
+
+    // the smallest document is the length and the terminator
+    if (size < 5) return false;
+
+    // the length of the document
+    int32_t length = load(data);
+
+    // the document must fit and be terminated
+    if (length < 5 || (size_t)length > size || data[length - 1] != 0) return false;
+
+    // process all elements, the terminator is not part of them
+    size_t position = 4, end = length - 1;
+    while (position < end)
+    {
+        // the type of the element
+        auto type = (signed char)data[position++];
+
+        // the field name
+        auto name = cstring(data + position, end - position);
+        if (name == 0) return false;
+        position += name;
+
+        // the number of bytes left for the value
+        size_t left = end - position;
+        const char *value = data + position;
+
+        // the size of the value
+        size_t used;
+
+        // check the value
+        switch (type)
+        {
+            case mongo::NumberDouble:   used = 8;   break;
+            case mongo::jstOID:         used = 12;  break;
+            case mongo::Date:           used = 8;   break;
+            case mongo::NumberInt:      used = 4;   break;
+            case mongo::Timestamp:      used = 8;   break;
+            case mongo::NumberLong:     used = 8;   break;
+            case 19: /* decimal128 */   used = 16;  break;
+            case 6:  /* undefined */    used = 0;   break;
+            case mongo::jstNULL:        used = 0;   break;
+            case mongo::MinKey:         used = 0;   break;
+            case mongo::MaxKey:         used = 0;   break;
+
+            case mongo::Bool:
+                // only zero and one are allowed
+                if (left < 1 || (unsigned char)value[0] > 1) return false;
+                used = 1;
+                break;
+
+            case mongo::String:
+            case 13: /* code */
+            case 14: /* symbol */
+                // a plain string
+                used = string(value, left);
+                if (used == 0) return false;
+                break;
+
+            case mongo::Object:
+            case mongo::Array:
+                // a nested document
+                if (!document(value, left, depth + 1)) return false;
+                used = load(value);
+                break;
+
+            case mongo::BinData: {
+                // the length, the subtype and the data
+                if (left < 5) return false;
+                int32_t bytes = load(value);
+                if (bytes < 0 || (size_t)bytes > left - 5) return false;
+                used = 5 + bytes;
+                break;
+            }
+
+            case 11: { /* regular expression */
+                // the pattern and the options
+                auto pattern = cstring(value, left);
+                if (pattern == 0) return false;
+                auto options = cstring(value + pattern, left - pattern);
+                if (options == 0) return false;
+                used = pattern + options;
+                break;
+            }
+
+            case 12: /* db pointer */
+                // a string followed by an object id
+                used = string(value, left);
+                if (used == 0 || left - used < 12) return false;
+                used += 12;
+                break;
+
+            case 15: { /* code with scope */
+                // the total length, the code and the scope
+                if (left < 4) return false;
+                int32_t total = load(value);
+                if (total < 14 || (size_t)total > left) return false;
+                auto code = string(value + 4, total - 4);
+                if (code == 0 || !document(value + 4 + code, total - 4 - code, depth + 1)) return false;
+                if ((size_t)(4 + code + load(value + 4 + code)) != (size_t)total) return false;
+                used = total;
+                break;
+            }
+
+            default:
+                // unknown type
+                return false;
+        }
+
+        // the value must fit
+        if (used > left) return false;
+
+        // move to the next element
+        position += used;
+    }
+
+    // the elements must end exactly at the terminator
+    return position == end;
+}
+
+/**
+ *  Check that a buffer holds a well formed bson document
+ *  with valid utf-8 in all its strings and field names
+ *
+ *  @param  data        the encoded document
+ *  @param  size        size of the buffer
+ *  @return bool
+ */
+bool Validator::validate(const char *data, size_t size)
+{
+    // the document must fill the buffer exactly
+    if (size < 5 || load(data) != (int32_t)size) return false;
+
+    // check the document
+    return document(data, size, 0);
+}
+
+/**
+ *  End namespace
+ */
+}}
@@ -0,0 +1,450 @@
+/**
+ *  WriteBehind.cpp
+ *
+ *  Buffer that collects updates of single documents, and merges
+ *  the updates of the same document, so that they can be sent to
+ *  the server as one update per document per interval.
+ *
+ *  @copyright 2014 Copernica BV
+ */
+
+#include "includes.h"
+
+/**
+ *  Set up namespace
+ */
+namespace React { namespace Mongo {
+
+/**
+ *  Find the operator with the given name
+ *
+ *  @param  name        name of the operator
+ *  @param  op          the operator to fill
+ *  @return bool        false if the operator is not supported
+ */
+static bool lookup(const std::string& name, WriteBehind::Operator& op)
+{
+    // check all supported operators
+    if (name == "$inc") { op = WriteBehind::Operator::Inc; return true; }
+    if (name == "$max") { op = WriteBehind::Operator::Max; return true; }
+    if (name == "$min") { op = WriteBehind::Operator::Min; return true; }
+    if (name == "$set") { op = WriteBehind::Operator::Set; return true; }
+
+    // not supported
+    return false;
+}
+
+/**
+ *  The name of an operator
+ *
+ *  @param  op          the operator
+ *  @return const char *
+ */
+static const char *name(WriteBehind::Operator op)
+{
+    // check the operator
+    switch (op)
+    {
+        case WriteBehind::Operator::Inc:    return "$inc";
+        case WriteBehind::Operator::Max:    return "$max";
+        case WriteBehind::Operator::Min:    return "$min";
+        default:                            return "$set";
+    }
+}
+
+/**
+ *  Is a value a number?
+ *
+ *  @param  value       the value to check
+ *  @return bool
+ */
+static bool numeric(const Variant::Value& value)
+{
+    return value.type() == Variant::ValueIntType || value.type() == Variant::ValueDoubleType;
+}
+
+/**
+ *  Does the sum of two numbers overflow an integer?
+ *
+ *  @param  a           the first number
+ *  @param  b           the second number
+ *  @return bool        false if either number is not an integer
+ */
+static bool overflows(const Variant::Value& a, const Variant::Value& b)
+{
+    // only integers can overflow
+    if (a.type() != Variant::ValueIntType || b.type() != Variant::ValueIntType) return false;
+
+    // add them in a wider type
+    long long sum = (long long)(int)a + (int)b;
+
+    // check whether it still fits
+    return sum < std::numeric_limits<int>::min() || sum > std::numeric_limits<int>::max();
+}
+
+/**
+ *  Add two numbers, the result is only an integer if both are
+ *  and the sum fits in one
+ *
+ *  @param  a           the first number
+ *  @param  b           the second number
+ *  @return Variant::Value
+ */
+static Variant::Value add(const Variant::Value& a, const Variant::Value& b)
+{
+    // integers stay integers
+    if (a.type() == Variant::ValueIntType && b.type() == Variant::ValueIntType && !overflows(a, b)) return Variant::Value((int)a + (int)b);
+
+    // anything else becomes a double
+    return Variant::Value((double)a + (double)b);
+}
+
+/**
+ *  Apply an update to a value
+ *
+ *  @param  op          the operator of the update
+ *  @param  current     the current value, null if there is none
+ *  @param  value       the value of the update
+ *  @return Variant::Value  the new value
+ */
+static Variant::Value update(WriteBehind::Operator op, const Variant::Value& current, const Variant::Value& value)
+{
+    // without a number to work on, the value is simply set
+    if (op == WriteBehind::Operator::Set || !numeric(current)) return value;
+
+    // check the operator
+    switch (op)
+    {
+        case WriteBehind::Operator::Inc:    return add(current, value);
+        case WriteBehind::Operator::Max:    return (double)value > (double)current ? value : current;
+        case WriteBehind::Operator::Min:    return (double)value < (double)current ? value : current;
+        default:                            return value;
+    }
+}
+
+/**
+ *  The query selecting the document
+ *
+ *  @return Variant::Value
+ */
+Variant::Value WriteBehind::Entry::query() const
+{
+    // select the document by its id
+    std::map<std::string, Variant::Value> result;
+    result["_id"] = id;
+
+    // done
+    return result;
+}
+
+/**
+ *  The update to send
+ *
+ *  @return Variant::Value
+ */
+Variant::Value WriteBehind::Entry::update() const
+{
+    // the fields per operator
+    std::map<std::string, std::map<std::string, Variant::Value>> operators;
+    for (auto &field : fields) operators[name(field.second.op)][field.first] = field.second.value;
+
+    // the update holds all operators
+    std::map<std::string, Variant::Value> result;
+    for (auto &op : operators) result[op.first] = op.second;
+
+    // done
+    return result;
+}
+
+/**
+ *  Build the key of a document
+ *
+ *  @param  collection  database name and collection
+ *  @param  id          the _id of the document
+ *  @param  key         string to store the key in
+ *  @return bool        false if the _id is not supported
+ */
+bool WriteBehind::key(const std::string& collection, const Variant::Value& id, std::string& key)
+{
+    // the key starts with the collection
+    key.assign(collection).push_back('\0');
+
+    // mongo compares numbers by value, so a double that holds an
+    // integer is the same id as the integer, other doubles cannot
+    // be recognized reliably and are not supported
+    if (id.type() == Variant::ValueDoubleType)
+    {
+        // the value of the id
+        double value = id;
+
+        // it must be an integer that fits, this is written so that
+        // nan fails as well, before it is converted
+        if (!(value >= std::numeric_limits<int>::min() && value <= std::numeric_limits<int>::max())) return false;
+        if (value != (int)value) return false;
+
+        // use the integer
+        key.append("i").append(std::to_string((int)value));
+        return true;
+    }
+
+    // followed by the type and the value of the id
+    switch (id.type())
+    {
+        case Variant::ValueIntType:     key.append("i").append(std::to_string((int)id));   return true;
+        case Variant::ValueStringType:  key.append("s").append((std::string)id);           return true;
+        default:                        return false;
+    }
+}
+
+/**
+ *  Merge an update of a field into the earlier updates
+ *
+ *  @param  field       the earlier updates
+ *  @param  op          the operator of the update
+ *  @param  value       the value of the update
+ *  @return bool        false if they cannot be merged
+ */
+bool WriteBehind::merge(Field& field, Operator op, const Variant::Value& value)
+{
+    // setting a value overrides whatever came before
+    if (op == Operator::Set) { field.op = Operator::Set; field.value = value; return true; }
+
+    // after setting a value, the other operators can be applied to it
+    if (field.op == Operator::Set)
+    {
+        // but only to numbers
+        if (!numeric(field.value)) return false;
+
+        // an integer that overflows is left to the server
+        if (op == Operator::Inc && overflows(field.value, value)) return false;
+
+        // the field is still set, to a different value
+        field.value = update(op, field.value, value);
+        return true;
+    }
+
+    // other operators can only be combined with themselves
+    if (field.op != op) return false;
+
+    // an integer that overflows is left to the server
+    if (op == Operator::Inc && overflows(field.value, value)) return false;
+
+    // combine the values
+    field.value = update(op, field.value, value);
+    return true;
+}
+
+/**
+ *  Can an update be collected at all?
+ *
+ *  @param  query       the query selecting the document
+ *  @param  document    the update
+ *  @return bool
+ */
+bool WriteBehind::supports(const Variant::Value& query, const Variant::Value& document)
+{
+    // the query must select a single document by its id
+    if (query.type() != Variant::ValueMapType || query.size() != 1 || !query.contains("_id")) return false;
+
+    // and the id must be of a type we can recognize
+    std::string dummy;
+    if (!key(std::string(), query.get("_id"), dummy)) return false;
+
+    // the update must consist of operators
+    if (document.type() != Variant::ValueMapType || document.size() == 0) return false;
+
+    // check all operators
+    std::map<std::string, Variant::Value> operators = document;
+    for (auto &entry : operators)
+    {
+        // the operator must be supported
+        Operator op;
+        if (!lookup(entry.first, op)) return false;
+
+        // it must hold fields
+        if (entry.second.type() != Variant::ValueMapType) return false;
+
+        // check all fields
+        std::map<std::string, Variant::Value> fields = entry.second;
+        for (auto &field : fields)
+        {
+            // only top level fields are supported
+            if (field.first.empty() || field.first[0] == '$' || field.first.find('.') != std::string::npos) return false;
+
+            // the operators other than $set need numbers
+            if (op != Operator::Set && !numeric(field.second)) return false;
+        }
+    }
+
+    // this update can be collected
+    return true;
+}
+
+/**
+ *  Are there updates for a collection that were not yet sent?
+ *
+ *  @param  collection  database name and collection
+ *  @return bool
+ */
+bool WriteBehind::pending(const std::string& collection) const
+{
+    // the keys of the collection start with its name and a terminator
+    std::string prefix(collection);
+    prefix.push_back('\0');
+
+    // find the first key of the collection
+    auto iter = _pending.lower_bound(prefix);
+
+    // check whether it belongs to the collection
+    return iter != _pending.end() && iter->first.compare(0, prefix.size(), prefix) == 0;
+}
+
+/**
+ *  Add an update to the buffer
+ *
+ *  @param  collection  database name and collection
+ *  @param  query       the query selecting the document
+ *  @param  document    the update
+ *  @param  upsert      should the document be created if it does not exist?
+ *  @param  deferred    the deferred to report to when the update is sent
+ *  @return bool        false if the update cannot be merged with the updates in the buffer
+ */
+bool WriteBehind::add(const std::string& collection, const Variant::Value& query, const Variant::Value& document, bool upsert, const std::shared_ptr<DeferredUpdate>& deferred)
+{
+    // the id of the document, and its key
+    auto id = query.get("_id");
+    std::string index;
+    key(collection, id, index);
+
+    // the earlier updates of the document, if any
+    auto iter = _pending.find(index);
+
+    // an upsert creates the document with the fields of the updates,
+    // merging it with a normal update would create it with more fields
+    if (iter != _pending.end() && iter->second.upsert != upsert) return false;
+
+    // the fields after this update, the buffer is only changed
+    // when all fields can be merged
+    std::map<std::string, Field> fields;
+    if (iter != _pending.end()) fields = iter->second.fields;
+
+    // merge all operators
+    std::map<std::string, Variant::Value> operators = document;
+    for (auto &entry : operators)
+    {
+        // the operator
+        Operator op;
+        lookup(entry.first, op);
+
+        // merge all fields
+        std::map<std::string, Variant::Value> values = entry.second;
+        for (auto &value : values)
+        {
+            // find the field
+            auto field = fields.find(value.first);
+
+            // a new field is simply added
+            if (field == fields.end()) fields.emplace(value.first, Field{ op, value.second });
+
+            // otherwise it must be merged
+            else if (!merge(field->second, op, value.second)) return false;
+        }
+    }
+
+    // add the document if it was not in the buffer yet
+    if (iter == _pending.end())
+    {
+        iter = _pending.emplace(index, Entry()).first;
+        iter->second.collection = collection;
+        iter->second.id = id;
+    }
+
+    // store the merged updates
+    iter->second.fields = std::move(fields);
+    iter->second.upsert = upsert;
+    iter->second.deferreds.push_back(deferred);
+
+    // the update was added
+    return true;
+}
+
+/**
+ *  Take the updates out of the buffer, to send them
+ *
+ *  @return the updates, or a null pointer if there are none
+ */
+std::shared_ptr<const WriteBehind::Batch> WriteBehind::take()
+{
+    // is there anything to send?
+    if (_pending.empty()) return nullptr;
+
+    // move the updates to a batch
+    auto batch = std::make_shared<const Batch>(std::move(_pending));
+    _pending.clear();
+
+    // remember it until it is sent
+    _flushing.emplace_back(_batches++, batch);
+
+    // done
+    return batch;
+}
+
+/**
+ *  Apply the updates in a batch to query results
+ *
+ *  @param  batch       the updates to apply
+ *  @param  collection  database name and collection that was queried
+ *  @param  documents   the documents to update
+ */
+void WriteBehind::apply(const Batch& batch, const std::string& collection, std::vector<Variant::Value>& documents)
+{
+    // the key of the document
+    std::string index;
+
+    // check all documents
+    for (auto &document : documents)
+    {
+        // we need the id
+        if (document.type() != Variant::ValueMapType || !document.contains("_id")) continue;
+
+        // find the updates of the document
+        if (!key(collection, document.get("_id"), index)) continue;
+        auto iter = batch.find(index);
+        if (iter == batch.end()) continue;
+
+        // apply all fields
+        for (auto &field : iter->second.fields)
+        {
+            // the current value
+            auto current = document.contains(field.first) ? document.get(field.first) : Variant::Value();
+
+            // update it
+            document[field.first] = update(field.second.op, current, field.second.value);
+        }
+    }
+}
+
+/**
+ *  Apply the updates the server did not yet have when a query ran
+ *
+ *  @param  collection  database name and collection that was queried
+ *  @param  snapshot    the snapshot taken when the query was started
+ *  @param  documents   the documents to update
+ */
+void WriteBehind::apply(const std::string& collection, size_t snapshot, std::vector<Variant::Value>& documents) const
+{
+    // the batches that were sent after the query ran, in the order they were sent
+    for (auto &flushing : _flushing)
+    {
+        // skip the batches the server already had
+        if (flushing.first >= snapshot) apply(*flushing.second, collection, documents);
+    }
+
+    // and the updates that were not sent at all
+    if (!_pending.empty()) apply(_pending, collection, documents);
+}
+
+/**
+ *  End namespace
+ */
+}}